@@ -0,0 +1,49 @@
+# SPDX-License-Identifier: CC0-1.0
+# Host-side tests for the hardware independent parts of main/. Run with: pytest host_test
+import ctypes
+import os
+import shutil
+import subprocess
+
+import pytest
+
+MAIN_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'main')
+
+
+def _compiler() -> str:
+    cc = os.environ.get('CC') or shutil.which('cc') or shutil.which('gcc')
+    if not cc:
+        pytest.skip('no host C compiler')
+    return cc
+
+
+@pytest.fixture(scope='session')
+def build_host(tmp_path_factory: pytest.TempPathFactory):
+    """Compile sources from main/ (plus optional host_test/ sources) for the host.
+
+    Returns a function taking the source file names and returning the built path.
+    Shared libraries are built when `shared` is true, executables otherwise.
+    """
+    out_dir = tmp_path_factory.mktemp('host_build')
+
+    def build(*sources: str, name: str, shared: bool = True, extra_flags: tuple = ()) -> str:
+        paths = []
+        for src in sources:
+            local = os.path.join(os.path.dirname(os.path.abspath(__file__)), src)
+            paths.append(local if os.path.exists(local) else os.path.join(MAIN_DIR, src))
+        out = os.path.join(str(out_dir), name + ('.so' if shared else ''))
+        cmd = [_compiler(), '-std=gnu11', '-O2', '-Wall', '-Werror', '-I', MAIN_DIR]
+        cmd += ['-shared', '-fPIC'] if shared else []
+        cmd += list(extra_flags) + paths + ['-o', out, '-lm']
+        subprocess.run(cmd, check=True)
+        return out
+
+    return build
+
+
+@pytest.fixture(scope='session')
+def load_host_lib(build_host):
+    def load(*sources: str, name: str) -> ctypes.CDLL:
+        return ctypes.CDLL(build_host(*sources, name=name))
+
+    return load
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: CC0-1.0
+// Device side of the host protocol for test_edm_protocol.py: edm_protocol.c on stdin/stdout
+// (a pty in the test) with a parameter table, commands and synthetic telemetry shaped like the
+// edm_link.c task, interleaved with console log lines the client has to skip.
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#include "edm_protocol.h"
+
+#define BATCH_RECORDS 8        // EDM_LINK_BATCH_RECORDS
+#define BATCH_MAX_AGE_MS 100   // EDM_LINK_BATCH_MAX_AGE_MS
+#define MAX_TELEMETRY_HZ 50    // EDM_LINK_MAX_TELEMETRY_HZ
+#define MIN_CUT_SPEED_UM_S 40 // stepper_uniform_min_freq_hz() at 1 MHz, 2 Hz at 50 steps/mm
+#define LOG_INTERVAL_MS 250
+
+static int32_t params[EDM_PARAM_TRIP_LATCHED + 1] = {
+    [EDM_PARAM_DUTY_PERCENT] = 40,
+    [EDM_PARAM_CUT_SPEED_UM_S] = 100,
+    [EDM_PARAM_GAP_LOW] = 500,
+    [EDM_PARAM_GAP_HIGH] = 2000,
+    [EDM_PARAM_ISOPULSE_ON_NS] = 5000,
+    [EDM_PARAM_ISOPULSE_OFF_NS] = 20000,
+    [EDM_PARAM_ISOPULSE_IGNITION_NS] = 50000,
+    [EDM_PARAM_TELEMETRY_HZ] = 0,
+    [EDM_PARAM_JOG_SPEED_UM_S] = 60000,
+    [EDM_PARAM_PEAK_CURRENT_MA] = 0,
+    [EDM_PARAM_TRIP_COUNT] = 3,
+    [EDM_PARAM_TRIP_CBC_CYCLES] = 7,
+    [EDM_PARAM_TRIP_OST_LATCHES] = 1,
+    [EDM_PARAM_TRIP_LATCHED] = 1,
+};
+static int cutting = 0;
+static int32_t position = 0;
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void write_all(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+        if (n <= 0) {
+            _exit(1);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+static bool get_param(uint8_t id, int32_t *out_value, void *ctx)
+{
+    if (id < EDM_PARAM_DUTY_PERCENT || id > EDM_PARAM_TRIP_LATCHED) {
+        return false;
+    }
+    *out_value = params[id];
+    return true;
+}
+
+static uint8_t set_param(uint8_t id, int32_t value, void *ctx)
+{
+    if (id < EDM_PARAM_DUTY_PERCENT || id > EDM_PARAM_TRIP_LATCHED) {
+        return EDM_PROTO_NACK_UNKNOWN_PARAM;
+    }
+    if (id >= EDM_PARAM_TRIP_COUNT) {
+        return EDM_PROTO_NACK_READ_ONLY;
+    }
+    bool ok = value >= 0;
+    switch (id) {
+    case EDM_PARAM_DUTY_PERCENT:
+        ok = ok && value <= 100;
+        break;
+    case EDM_PARAM_CUT_SPEED_UM_S:
+        ok = value >= MIN_CUT_SPEED_UM_S;
+        break;
+    case EDM_PARAM_GAP_LOW:
+        ok = ok && value < params[EDM_PARAM_GAP_HIGH];
+        break;
+    case EDM_PARAM_GAP_HIGH:
+        ok = value > params[EDM_PARAM_GAP_LOW] && value <= 4095;
+        break;
+    case EDM_PARAM_TELEMETRY_HZ:
+        ok = ok && value <= MAX_TELEMETRY_HZ;
+        break;
+    default:
+        break;
+    }
+    if (!ok) {
+        return EDM_PROTO_NACK_OUT_OF_RANGE;
+    }
+    params[id] = value;
+    return 0;
+}
+
+static uint8_t command(uint8_t cmd, int32_t arg, void *ctx)
+{
+    switch (cmd) {
+    case EDM_CMD_START:
+        cutting = 1;
+        return 0;
+    case EDM_CMD_STOP:
+        cutting = 0;
+        return 0;
+    case EDM_CMD_JOG:
+        if (cutting) {
+            return EDM_PROTO_NACK_BUSY;
+        }
+        position += arg;
+        return 0;
+    case EDM_CMD_CLEAR_TRIP:
+        params[EDM_PARAM_TRIP_LATCHED] = 0;
+        return 0;
+    default:
+        return EDM_PROTO_NACK_UNKNOWN_COMMAND;
+    }
+}
+
+int main(void)
+{
+    static edm_proto_parser_t parser;
+    static edm_proto_frame_t request;
+    static uint8_t tx[EDM_PROTO_MAX_FRAME];
+    static session_sample_t batch[BATCH_RECORDS];
+    const edm_proto_handlers_t handlers = { get_param, set_param, command, NULL };
+    uint8_t rx[64];
+    uint8_t telemetry_seq = 0;
+    size_t batch_count = 0;
+    uint32_t batch_start = 0;
+    uint32_t start = now_ms();
+    uint32_t last_sample = start;
+    uint32_t last_log = start;
+
+    while (1) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        struct timeval tv = { .tv_sec = 0, .tv_usec = 5000 };
+        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0) {
+            ssize_t n = read(STDIN_FILENO, rx, sizeof(rx));
+            if (n <= 0) {
+                return 0; // host side closed
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                if (edm_proto_feed(&parser, rx[i], &request)) {
+                    write_all(tx, edm_proto_handle(&request, &handlers, tx, sizeof(tx)));
+                }
+            }
+        }
+
+        uint32_t now = now_ms();
+        if (now - last_log >= LOG_INTERVAL_MS) {
+            char line[64];
+            int len = snprintf(line, sizeof(line), "I (%u) main: EDM: Gap OK, holding position\r\n", (unsigned)(now - start));
+            write_all(line, len);
+            last_log = now;
+        }
+        int32_t hz = params[EDM_PARAM_TELEMETRY_HZ];
+        if (hz && now - last_sample >= 1000u / hz) {
+            last_sample = now;
+            session_sample_t *s = &batch[batch_count];
+            s->time_ms = now - start;
+            s->position_steps = position;
+            s->gap_adc = 1000 + (s->time_ms % 500);
+            s->servo = cutting ? 1 : 0;
+            s->pulse_class = 1;
+            if (batch_count++ == 0) {
+                batch_start = now;
+            }
+        }
+        if (batch_count == BATCH_RECORDS || (batch_count && now - batch_start >= BATCH_MAX_AGE_MS)) {
+            write_all(tx, edm_proto_encode_telemetry(batch, batch_count, telemetry_seq++, tx, sizeof(tx)));
+            batch_count = 0;
+        }
+    }
+}
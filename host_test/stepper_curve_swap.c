@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: CC0-1.0
+// Curve swap under concurrent transmits, for test_stepper_curve.py. An updater thread prepares
+// and publishes a series of curves as fast as it can while a transmit thread runs transactions,
+// copying each one out in small chunks with yields in between, like RMT memory refills. Every
+// transaction has to match one published curve exactly, and the curves have to come in order.
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stepper_curve.h"
+
+#define NUM_CURVES 400
+#define MAX_POINTS 128
+#define CHUNK_SYMBOLS 8
+
+static stepper_curve_t curve;
+static uint32_t storage[STEPPER_CURVE_SLOTS * MAX_POINTS];
+static stepper_curve_config_t configs[NUM_CURVES];
+static uint32_t expected[NUM_CURVES][MAX_POINTS];
+static volatile int updater_done = 0;
+
+static void make_config(int k, stepper_curve_config_t *config)
+{
+    config->resolution = 1000000;
+    config->sample_points = 32 + (k % 4) * 32;
+    uint32_t low = 500 + 7 * k;
+    uint32_t high = low + 1000 + 3 * k;
+    // Alternate acceleration and deceleration so the play out side changes too
+    config->start_freq_hz = k % 2 ? high : low;
+    config->end_freq_hz = k % 2 ? low : high;
+}
+
+static void *updater(void *arg)
+{
+    for (int k = 1; k < NUM_CURVES; k++) {
+        if (!stepper_curve_prepare(&curve, &configs[k])) {
+            fprintf(stderr, "prepare %d failed\n", k);
+            exit(2);
+        }
+        stepper_curve_publish(&curve);
+        for (int i = rand() % 64; i > 0; i--) {
+            sched_yield();
+        }
+    }
+    __atomic_store_n(&updater_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Which curve a transaction of `steps` steps played, -1 for a mix. Short moves on neighbouring
+// curves can be identical, so the search starts at the last curve seen.
+static int match(const uint32_t *symbols, uint32_t count, uint32_t steps, int from)
+{
+    for (int i = 0; i < NUM_CURVES; i++) {
+        int k = (from + i) % NUM_CURVES;
+        uint32_t points = configs[k].sample_points;
+        uint32_t n = steps < points ? steps : points;
+        bool accel = configs[k].start_freq_hz < configs[k].end_freq_hz;
+        if (n == count && memcmp(symbols, accel ? expected[k] : expected[k] + points - n, n * sizeof(uint32_t)) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+int main(void)
+{
+    for (int k = 0; k < NUM_CURVES; k++) {
+        stepper_curve_t scratch;
+        static uint32_t scratch_storage[STEPPER_CURVE_SLOTS * MAX_POINTS];
+        make_config(k, &configs[k]);
+        if (!stepper_curve_init(&scratch, scratch_storage, MAX_POINTS, &configs[k])) {
+            fprintf(stderr, "config %d invalid\n", k);
+            return 2;
+        }
+        memcpy(expected[k], scratch_storage, sizeof(expected[k]));
+    }
+    stepper_curve_init(&curve, storage, MAX_POINTS, &configs[0]);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, updater, NULL);
+    int transactions = 0, torn = 0, regressions = 0, distinct = 0, last = 0;
+    int done = 0;
+    while (!done) {
+        done = __atomic_load_n(&updater_done, __ATOMIC_ACQUIRE); // one more transaction after the updater finished
+        stepper_curve_begin(&curve);
+        uint32_t steps = 1 + rand() % (MAX_POINTS + 16);
+        uint32_t count;
+        const uint32_t *symbols = stepper_curve_symbols(&curve, steps, &count);
+        uint32_t played[MAX_POINTS];
+        for (uint32_t i = 0; i < count; i += CHUNK_SYMBOLS) {
+            uint32_t n = count - i < CHUNK_SYMBOLS ? count - i : CHUNK_SYMBOLS;
+            memcpy(&played[i], &symbols[i], n * sizeof(uint32_t));
+            sched_yield();
+        }
+        int k = match(played, count, steps, last);
+        transactions++;
+        if (k < 0) {
+            torn++;
+        } else if (k < last) {
+            regressions++;
+        } else {
+            distinct += k != last;
+            last = k;
+        }
+    }
+    pthread_join(thread, NULL);
+    printf("transactions=%d distinct=%d torn=%d regressions=%d last=%d\n", transactions, distinct, torn, regressions, last);
+    return torn || regressions || last != NUM_CURVES - 1;
+}
@@ -0,0 +1,223 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import math
+import random
+
+import pytest
+
+# MCPWM_task.c settings
+PERIOD_TICKS = 500         # PWM_RESOLUTION_HZ / PWM_FREQ_HZ
+TICK_S = 1e-7              # PWM_RESOLUTION_HZ = 10 MHz
+LOOP_DIVIDER = 4           # CURRENT_LOOP_DIVIDER
+SENSE_FULL_SCALE_MA = 40000  # CURRENT_SENSE_FULL_SCALE_MA at ADC count 4095
+KP_Q16 = 20
+KI_Q16 = 100
+SLEW_TICKS_Q16 = 5 << 16
+SOFT_START_TICKS_Q16 = 6554  # 0.1 tick per update
+MAX_COMPARE = PERIOD_TICKS * 80 // 100
+UPDATE_S = LOOP_DIVIDER * PERIOD_TICKS * TICK_S
+
+
+class RegulatorConfig(ctypes.Structure):
+    _fields_ = [('kp_q16', ctypes.c_int32),
+                ('ki_q16', ctypes.c_int32),
+                ('slew_ticks_q16', ctypes.c_uint32),
+                ('soft_start_ticks_q16', ctypes.c_uint32)]
+
+
+class Regulator(ctypes.Structure):
+    _fields_ = [('config', RegulatorConfig),
+                ('compare_q16', ctypes.c_int32),
+                ('ceiling_q16', ctypes.c_int32),
+                ('last_error_ma', ctypes.c_int32)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('current_regulator.c', name='current_regulator')
+    lib.current_regulator_init.argtypes = [ctypes.POINTER(Regulator), ctypes.POINTER(RegulatorConfig)]
+    lib.current_regulator_restart.argtypes = [ctypes.POINTER(Regulator)]
+    lib.current_regulator_update.argtypes = [ctypes.POINTER(Regulator), ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32]
+    lib.current_regulator_update.restype = ctypes.c_uint32
+    lib.current_regulator_update_braked.argtypes = [ctypes.POINTER(Regulator), ctypes.c_uint32, ctypes.c_uint32, ctypes.c_uint32]
+    lib.current_regulator_update_braked.restype = ctypes.c_uint32
+    lib.current_regulator_update_open_loop.argtypes = [ctypes.POINTER(Regulator), ctypes.c_uint32]
+    lib.current_regulator_update_open_loop.restype = ctypes.c_uint32
+    return lib
+
+
+class RLLoad:
+    """Half-bridge into a series RL load: supply across it while on, freewheeling while off"""
+
+    def __init__(self, volts: float = 100.0, ohms: float = 2.0, henries: float = 20e-6) -> None:
+        self.volts, self.ohms, self.henries = volts, ohms, henries
+        self.current = 0.0
+
+    def cycle(self, compare_ticks: int) -> float:
+        """Run one PWM period, returns the peak current in A"""
+        tau = self.henries / self.ohms
+        t_on = compare_ticks * TICK_S
+        final = self.volts / self.ohms
+        self.current = final + (self.current - final) * math.exp(-t_on / tau)
+        peak = self.current
+        self.current *= math.exp(-(PERIOD_TICKS - compare_ticks) * TICK_S / tau)
+        return peak
+
+
+class BrakedLoad(RLLoad):
+    """RL load behind the cycle-by-cycle brake: a pulse ends early once the current reaches trip_a"""
+
+    def __init__(self, trip_a: float, **kwargs) -> None:
+        super().__init__(**kwargs)
+        self.trip_a = trip_a
+        self.braked = False  # a pulse was cut since the flag was last cleared
+
+    def cycle(self, compare_ticks: int) -> float:
+        tau = self.henries / self.ohms
+        final = self.volts / self.ohms
+        t_on = compare_ticks * TICK_S
+        if self.current >= self.trip_a:
+            t_on, self.braked = 0.0, self.braked or compare_ticks > 0
+        elif final > self.trip_a:
+            t_trip = -tau * math.log((final - self.trip_a) / (final - self.current))
+            if t_trip < t_on:
+                t_on, self.braked = t_trip, True
+        self.current = final + (self.current - final) * math.exp(-t_on / tau)
+        peak = self.current
+        self.current *= math.exp(-(PERIOD_TICKS * TICK_S - t_on) / tau)
+        return peak
+
+
+class Loop:
+    """TEZ ISR model: every LOOP_DIVIDER cycles read the peak hold (last pulse), write a compare
+    value that latches at the next TEZ"""
+
+    def __init__(self, lib, load: RLLoad, seed: int = 1) -> None:
+        self.lib, self.load = lib, load
+        self.reg = Regulator()
+        config = RegulatorConfig(KP_Q16, KI_Q16, SLEW_TICKS_Q16, SOFT_START_TICKS_Q16)
+        lib.current_regulator_init(ctypes.byref(self.reg), ctypes.byref(config))
+        self.rng = random.Random(seed)
+        self.compare = 0
+        self.last_peak = 0.0
+        self.compares, self.peaks = [], []
+
+    def sense_ma(self) -> int:
+        counts = round(self.last_peak * 1000 * 4095 / SENSE_FULL_SCALE_MA) + self.rng.randint(-2, 2)
+        counts = max(0, min(4095, counts))
+        return counts * SENSE_FULL_SCALE_MA // 4095
+
+    def run(self, seconds: float, target_ma: int = None, open_loop_compare: int = None, hold_on_brake: bool = True) -> None:
+        for _ in range(round(seconds / UPDATE_S)):
+            # The ISR compares the CBC brake counter with its value at the previous update
+            braked = getattr(self.load, 'braked', False)
+            self.load.braked = False
+            if target_ma is not None and braked and hold_on_brake:
+                new = self.lib.current_regulator_update_braked(ctypes.byref(self.reg), target_ma, self.sense_ma(), MAX_COMPARE)
+            elif target_ma is not None:
+                new = self.lib.current_regulator_update(ctypes.byref(self.reg), target_ma, self.sense_ma(), MAX_COMPARE)
+            else:
+                new = self.lib.current_regulator_update_open_loop(ctypes.byref(self.reg), open_loop_compare)
+            for _ in range(LOOP_DIVIDER):
+                self.last_peak = self.load.cycle(self.compare)
+                self.compare = new  # latched at TEZ, used from the next period
+            self.compares.append(new)
+            self.peaks.append(self.last_peak)
+
+
+def settle_index(peaks, target_a: float, band: float) -> int:
+    """First update after which the peak stays within target +- band"""
+    for i in range(len(peaks) - 1, -1, -1):
+        if abs(peaks[i] - target_a) > band * target_a:
+            return i + 1
+    return 0
+
+
+def test_soft_start_settles_on_target(lib) -> None:
+    loop = Loop(lib, RLLoad())
+    loop.run(0.3, target_ma=20000)
+    for i, compare in enumerate(loop.compares):
+        assert compare <= (i + 1) * SOFT_START_TICKS_Q16 / 65536 + 1  # never ahead of the soft start ceiling
+    first = next(i for i, p in enumerate(loop.peaks) if p >= 20.0)
+    assert max(loop.peaks[first:]) < 20.0 * 1.05
+    tail = loop.peaks[-200:]
+    assert sum(tail) / len(tail) == pytest.approx(20.0, rel=0.01)
+    print('soft start to 20 A: {:.1f} ms'.format(settle_index(loop.peaks, 20.0, 0.02) * UPDATE_S * 1000))
+
+
+def test_load_step_recovers(lib) -> None:
+    load = RLLoad()
+    loop = Loop(lib, load)
+    loop.run(0.3, target_ma=20000)
+    start = len(loop.peaks)
+    load.ohms = 1.0  # gap narrows: twice the available current, half the resistance
+    loop.run(0.05, target_ma=20000)
+    after = loop.peaks[start:]
+    settle_ms = settle_index(after, 20.0, 0.05) * UPDATE_S * 1000
+    print('load step 2 -> 1 ohm: peak {:.1f} A, back within 5% after {:.1f} ms'.format(max(after), settle_ms))
+    assert max(after) < 20.0 * 1.6
+    assert settle_ms < 5
+
+
+def test_target_step_respects_slew(lib) -> None:
+    loop = Loop(lib, RLLoad())
+    loop.run(0.3, target_ma=20000)
+    start = len(loop.compares)
+    loop.run(0.05, target_ma=10000)
+    compares = loop.compares[start - 1:]
+    assert max(abs(b - a) for a, b in zip(compares, compares[1:])) <= SLEW_TICKS_Q16 >> 16
+    tail = loop.peaks[-50:]
+    assert sum(tail) / len(tail) == pytest.approx(10.0, rel=0.02)
+
+
+def test_saturation_does_not_wind_up(lib) -> None:
+    loop = Loop(lib, RLLoad())
+    loop.run(1.0, target_ma=60000)  # above the 50 A the supply can drive through 2 ohm
+    assert loop.compares[-1] == MAX_COMPARE
+    start = len(loop.peaks)
+    loop.run(0.05, target_ma=20000)
+    settle_ms = settle_index(loop.peaks[start:], 20.0, 0.05) * UPDATE_S * 1000
+    # Limited only by the slew rate: 400 -> ~50 ticks at 5 ticks per update
+    assert settle_ms < 20
+
+
+def test_cbc_brake_freezes_integrator(lib) -> None:
+    # 30 A wanted, the brake cuts every pulse at 25 A: the clipped error must not integrate
+    held = Loop(lib, BrakedLoad(25.0))
+    held.run(1.0, target_ma=30000)
+    free = Loop(lib, BrakedLoad(25.0))
+    free.run(1.0, target_ma=30000, hold_on_brake=False)
+    assert free.compares[-1] == MAX_COMPARE
+    print('compare under the brake: held {}, without hold {}'.format(held.compares[-1], free.compares[-1]))
+    assert held.compares[-1] < MAX_COMPARE // 2
+    # Back below the trip level, the frozen loop only has to correct from where the brake stopped it
+    settle = []
+    for loop in (held, free):
+        start = len(loop.peaks)
+        loop.run(0.05, target_ma=20000, hold_on_brake=loop is held)
+        settle.append(settle_index(loop.peaks[start:], 20.0, 0.05))
+    assert settle[0] < settle[1]
+
+
+def test_restart_soft_starts_again(lib) -> None:
+    loop = Loop(lib, RLLoad())
+    loop.run(0.3, target_ma=20000)
+    lib.current_regulator_restart(ctypes.byref(loop.reg))
+    loop.compares.clear()
+    loop.run(0.01, target_ma=20000)
+    assert loop.compares[0] == 0
+    assert max(loop.compares) <= len(loop.compares) * SOFT_START_TICKS_Q16 / 65536 + 1
+
+
+def test_open_loop_duty(lib) -> None:
+    loop = Loop(lib, RLLoad())
+    loop.run(1.0, open_loop_compare=200)
+    ramp_updates = next(i for i, c in enumerate(loop.compares) if c == 200)
+    assert ramp_updates == pytest.approx(199.5 / (SOFT_START_TICKS_Q16 / 65536), abs=2)  # rounded to ticks
+    assert set(loop.compares[ramp_updates:]) == {200}
+    start = len(loop.compares)
+    loop.run(0.01, open_loop_compare=100)
+    assert loop.compares[start] == 100  # less duty applies at once
+    start = len(loop.compares)
+    loop.run(0.01, open_loop_compare=150)
+    assert loop.compares[-1] == 105  # more duty ramps at the soft start rate
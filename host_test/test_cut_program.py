@@ -0,0 +1,199 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import os
+
+import pytest
+
+from test_isopulse import IsopulseTiming
+
+STEPS_PER_MM = 200 / 4.0  # steps_per_rev / leadscrew_pitch_mm in main.c
+RESOLUTION_HZ = 10000000
+STEP_RESOLUTION_HZ = 1000000  # STEP_MOTOR_RESOLUTION_HZ in main.c
+MAX_STAGES = 16
+
+
+class CutStage(ctypes.Structure):
+    _fields_ = [('target_depth_mm', ctypes.c_double),
+                ('feed_speed_mm_per_s', ctypes.c_double),
+                ('duty_percent', ctypes.c_int),
+                ('on_time_ns', ctypes.c_uint32),
+                ('off_time_ns', ctypes.c_uint32),
+                ('max_ignition_ns', ctypes.c_uint32),
+                ('gap_low', ctypes.c_int),
+                ('gap_high', ctypes.c_int),
+                ('lift_period_ms', ctypes.c_uint32),
+                ('lift_min_period_ms', ctypes.c_uint32),
+                ('target_steps', ctypes.c_int32),
+                ('feed_freq_hz', ctypes.c_uint32),
+                ('isopulse', IsopulseTiming)]
+
+
+class CutProgram(ctypes.Structure):
+    _fields_ = [('stages', CutStage * MAX_STAGES),
+                ('num_stages', ctypes.c_size_t)]
+
+
+class CutProgramExec(ctypes.Structure):
+    _fields_ = [('program', ctypes.POINTER(CutProgram)),
+                ('stage', ctypes.c_size_t),
+                ('done', ctypes.c_bool),
+                ('last_sample_ms', ctypes.c_uint32),
+                ('last_sample_steps', ctypes.c_int32),
+                ('rate_steps_per_s', ctypes.c_double)]
+
+
+class CutProgramProgress(ctypes.Structure):
+    _fields_ = [('stage', ctypes.c_size_t),
+                ('num_stages', ctypes.c_size_t),
+                ('depth_mm', ctypes.c_double),
+                ('target_depth_mm', ctypes.c_double),
+                ('percent', ctypes.c_double),
+                ('rate_mm_per_min', ctypes.c_double),
+                ('eta_s', ctypes.c_uint32),
+                ('eta_valid', ctypes.c_bool)]
+
+
+DEFAULTS = CutStage(feed_speed_mm_per_s=0.1, duty_percent=40, gap_low=500, gap_high=2000,
+                    lift_period_ms=2000, lift_min_period_ms=500)
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('cut_program.c', 'isopulse.c', name='cut_program')
+    lib.cut_program_parse.argtypes = [ctypes.c_char_p, ctypes.POINTER(CutStage), ctypes.POINTER(CutProgram), ctypes.c_char_p, ctypes.c_size_t]
+    lib.cut_program_parse.restype = ctypes.c_bool
+    lib.cut_program_prepare.argtypes = [ctypes.POINTER(CutProgram), ctypes.c_double, ctypes.c_uint32, ctypes.c_uint32,
+                                        ctypes.c_char_p, ctypes.c_size_t]
+    lib.cut_program_prepare.restype = ctypes.c_bool
+    lib.cut_program_start.argtypes = [ctypes.POINTER(CutProgramExec), ctypes.POINTER(CutProgram), ctypes.c_uint32]
+    lib.cut_program_resume.argtypes = [ctypes.POINTER(CutProgramExec), ctypes.c_int32, ctypes.c_uint32]
+    lib.cut_program_update.argtypes = [ctypes.POINTER(CutProgramExec), ctypes.c_int32, ctypes.c_uint32]
+    lib.cut_program_update.restype = ctypes.c_bool
+    lib.cut_program_current_stage.argtypes = [ctypes.POINTER(CutProgramExec)]
+    lib.cut_program_current_stage.restype = ctypes.POINTER(CutStage)
+    lib.cut_program_get_progress.argtypes = [ctypes.POINTER(CutProgramExec), ctypes.c_int32, ctypes.c_double, ctypes.POINTER(CutProgramProgress)]
+    return lib
+
+
+def load(lib, text: str):
+    """Parse and prepare like cut_program_load() does, returns (program, error)"""
+    program = CutProgram()
+    err = ctypes.create_string_buffer(64)
+    ok = lib.cut_program_parse(text.encode(), ctypes.byref(DEFAULTS), ctypes.byref(program), err, len(err))
+    ok = ok and lib.cut_program_prepare(ctypes.byref(program), STEPS_PER_MM, STEP_RESOLUTION_HZ, RESOLUTION_HZ, err, len(err))
+    return (program if ok else None), err.value.decode()
+
+
+def test_shipped_program_is_valid(lib) -> None:
+    with open(os.path.join(os.path.dirname(__file__), '..', 'main', 'cut_program.txt')) as f:
+        program, err = load(lib, f.read())
+    assert program is not None, err
+    assert program.num_stages == 3
+
+
+def test_stages_inherit_previous_settings(lib) -> None:
+    program, err = load(lib, 'stage depth=0.5 duty=30  # roughing\n\n'
+                             'stage depth=1.0 on_ns=5000 off_ns=20000 ignition_ns=50000 gap_low=600\n'
+                             'stage depth=1.5 feed=0.2\n')
+    assert program is not None, err
+    first, second, third = program.stages[:3]
+    assert (first.target_steps, first.duty_percent, first.feed_freq_hz, first.on_time_ns) == (25, 30, 5, 0)
+    assert (second.target_steps, second.gap_low, second.gap_high, second.lift_period_ms) == (50, 600, 2000, 2000)
+    assert second.isopulse.compare_ticks == 550
+    assert (third.on_time_ns, third.gap_low, third.feed_freq_hz) == (5000, 600, 10)
+
+
+@pytest.mark.parametrize('text, message', [
+    ('stage duty=30\n', 'line 1: stage needs a depth'),
+    ('stage depth=1\nmove depth=2\n', "line 2: unknown directive 'move'"),
+    ('stage depth=1 duty=130\n', "line 1: bad setting 'duty'"),
+    ('stage depth=1 speed=3\n', "line 1: bad setting 'speed'"),
+    ('stage depth=1 duty\n', "line 1: expected key=value, got 'duty'"),
+    ('# nothing\n', 'line 1: program has no stages'),
+    ('stage depth=1\n' * 17, 'line 17: too many stages'),
+    ('stage depth=1\nstage depth=1\n', 'stage 2: depth must increase by at least one step'),
+    ('stage depth=1 gap_low=2500\n', 'stage 1: gap_low must be below gap_high'),
+    ('stage depth=1 on_ns=5000 off_ns=20000 ignition_ns=9000000\n', 'stage 1: isopulse timing does not fit the PWM timer'),
+    ('stage depth=1 lift_min_ms=3000\n', 'stage 1: lift_min_ms above lift_period_ms'),
+    ('stage depth=1 feed=0\n', 'stage 1: feed out of range'),
+    ('stage depth=1 feed=0.02\n', 'stage 1: feed out of range'),  # 1 Hz, more than 8 symbols per half period
+    ('stage depth=1 feed=nan\n', "line 1: bad setting 'feed'"),
+    ('stage depth=1 feed=inf\n', "line 1: bad setting 'feed'"),
+    ('stage depth=nan\n', "line 1: bad setting 'depth'"),
+    ('stage depth=-inf\n', "line 1: bad setting 'depth'"),
+])
+def test_rejects_bad_programs(lib, text: str, message: str) -> None:
+    program, err = load(lib, text)
+    assert program is None
+    assert err == message
+
+
+def test_prepare_rejects_nan_set_directly(lib) -> None:
+    # Stages built in code skip the parser, prepare must not let NaN through its range checks
+    for field in ('target_depth_mm', 'feed_speed_mm_per_s'):
+        program = CutProgram(num_stages=1)
+        program.stages[0] = DEFAULTS
+        program.stages[0].target_depth_mm = 1.0
+        setattr(program.stages[0], field, float('nan'))
+        assert not lib.cut_program_prepare(ctypes.byref(program), STEPS_PER_MM, STEP_RESOLUTION_HZ, RESOLUTION_HZ, None, 0)
+    assert not lib.cut_program_prepare(ctypes.byref(program), float('nan'), STEP_RESOLUTION_HZ, RESOLUTION_HZ, None, 0)
+
+
+def test_slowest_feed_fits_the_uniform_encoder(lib) -> None:
+    # 1 MHz / 2 Hz / 2 = 250000 ticks per half period, 8 symbols of 31250
+    program, err = load(lib, 'stage depth=1 feed=0.04\n')
+    assert program is not None, err
+    assert program.stages[0].feed_freq_hz == 2
+    assert load(lib, 'stage depth=1 feed=0.02\n')[1] == 'stage 1: feed out of range'
+
+
+def test_executor_walks_stages_and_reports_eta(lib) -> None:
+    program, err = load(lib, 'stage depth=0.2\nstage depth=0.4\nstage depth=1.0\n')
+    assert program is not None, err
+    exec_ = CutProgramExec()
+    lib.cut_program_start(ctypes.byref(exec_), ctypes.byref(program), 1000)
+    assert lib.cut_program_current_stage(ctypes.byref(exec_)).contents.target_steps == 10
+
+    progress = CutProgramProgress()
+    lib.cut_program_get_progress(ctypes.byref(exec_), 0, STEPS_PER_MM, ctypes.byref(progress))
+    assert not progress.eta_valid
+
+    # Remove one step per second
+    changes = []
+    for second in range(1, 51):
+        if lib.cut_program_update(ctypes.byref(exec_), second, 1000 + second * 1000):
+            changes.append(second)
+        if second == 25:
+            lib.cut_program_get_progress(ctypes.byref(exec_), second, STEPS_PER_MM, ctypes.byref(progress))
+            assert progress.stage == 2
+            assert progress.eta_valid and progress.eta_s == 25
+            assert progress.percent == pytest.approx(50.0)
+            assert progress.rate_mm_per_min == pytest.approx(60 / STEPS_PER_MM)
+    assert changes == [10, 20, 50]
+    assert exec_.done
+    assert not lib.cut_program_current_stage(ctypes.byref(exec_))
+
+
+def test_resume_keeps_stage_and_ignores_pause_in_rate(lib) -> None:
+    program, _ = load(lib, 'stage depth=0.2\nstage depth=0.4\nstage depth=1.0\n')
+    exec_ = CutProgramExec()
+    lib.cut_program_start(ctypes.byref(exec_), ctypes.byref(program), 0)
+    for second in range(1, 16):
+        lib.cut_program_update(ctypes.byref(exec_), second, second * 1000)
+    assert exec_.stage == 1
+    rate = exec_.rate_steps_per_s
+    # Paused for a minute and jogged back 5 steps, then resumed
+    lib.cut_program_resume(ctypes.byref(exec_), 10, 75000)
+    assert exec_.stage == 1 and not exec_.done
+    assert not lib.cut_program_update(ctypes.byref(exec_), 11, 76000)
+    assert exec_.rate_steps_per_s == pytest.approx(rate)
+    assert lib.cut_program_update(ctypes.byref(exec_), 20, 77000)  # same absolute stage target
+    assert exec_.stage == 2
+
+
+def test_stage_skip_on_large_jump(lib) -> None:
+    program, _ = load(lib, 'stage depth=0.2\nstage depth=0.4\nstage depth=1.0\n')
+    exec_ = CutProgramExec()
+    lib.cut_program_start(ctypes.byref(exec_), ctypes.byref(program), 0)
+    assert lib.cut_program_update(ctypes.byref(exec_), 25, 10)
+    assert exec_.stage == 2 and not exec_.done
@@ -0,0 +1,167 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import os
+import pty
+import subprocess
+import sys
+import tty
+
+import pytest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools'))
+import edm_client  # noqa: E402
+from test_session_recorder import SessionSample  # noqa: E402
+
+MAX_FRAME = 5 + 240 + 2
+
+
+class ProtoFrame(ctypes.Structure):
+    _fields_ = [('type', ctypes.c_uint8),
+                ('seq', ctypes.c_uint8),
+                ('len', ctypes.c_uint16),
+                ('payload', ctypes.c_uint8 * 240)]
+
+
+class ProtoParser(ctypes.Structure):
+    _fields_ = [('buf', ctypes.c_uint8 * MAX_FRAME),
+                ('pos', ctypes.c_uint16),
+                ('crc_errors', ctypes.c_uint32)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('edm_protocol.c', 'crc16.c', name='edm_protocol')
+    lib.edm_proto_encode.argtypes = [ctypes.c_uint8, ctypes.c_uint8, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+    lib.edm_proto_encode.restype = ctypes.c_size_t
+    lib.edm_proto_feed.argtypes = [ctypes.POINTER(ProtoParser), ctypes.c_uint8, ctypes.POINTER(ProtoFrame)]
+    lib.edm_proto_feed.restype = ctypes.c_bool
+    lib.edm_proto_encode_telemetry.argtypes = [ctypes.POINTER(SessionSample), ctypes.c_size_t, ctypes.c_uint8, ctypes.c_char_p, ctypes.c_size_t]
+    lib.edm_proto_encode_telemetry.restype = ctypes.c_size_t
+    return lib
+
+
+@pytest.fixture
+def device(build_host):
+    """Device simulator on a raw pty, as the board would appear on a USB serial port"""
+    sim = build_host('edm_link_sim.c', 'edm_protocol.c', 'crc16.c', name='edm_link_sim', shared=False)
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    tty.setraw(master)
+    proc = subprocess.Popen([sim], stdin=slave, stdout=slave, close_fds=True)
+    os.close(slave)
+    client = edm_client.EdmClient(edm_client.FdTransport(master), timeout=2.0)
+    yield client
+    os.close(master)
+    proc.wait(timeout=5)
+
+
+def c_feed(lib, data: bytes):
+    parser, frame, frames = ProtoParser(), ProtoFrame(), []
+    for byte in data:
+        if lib.edm_proto_feed(ctypes.byref(parser), byte, ctypes.byref(frame)):
+            frames.append((frame.type, frame.seq, bytes(frame.payload[:frame.len])))
+    return frames, parser.crc_errors
+
+
+def test_codec_matches_firmware(lib) -> None:
+    out = ctypes.create_string_buffer(MAX_FRAME)
+    for payload in (b'', b'\x01', bytes(range(240))):
+        n = lib.edm_proto_encode(0x12, 7, payload, len(payload), out, MAX_FRAME)
+        assert out.raw[:n] == edm_client.encode_frame(0x12, 7, payload)
+    assert lib.edm_proto_encode(0x12, 7, bytes(241), 241, out, MAX_FRAME) == 0
+
+    samples = (SessionSample * 3)((1000, -5, 1200, -1, 2), (1020, -6, 900, 2, 3), (4000000000, 1 << 30, 4095, 1, 0))
+    n = lib.edm_proto_encode_telemetry(samples, 3, 9, out, MAX_FRAME)
+    frames = list(edm_client.FrameParser().feed(out.raw[:n]))
+    assert len(frames) == 1 and frames[0].type == edm_client.MSG_TELEMETRY and frames[0].seq == 9
+    assert edm_client.decode_telemetry(frames[0].payload) == [
+        (1000, -5, 1200, -1, 2), (1020, -6, 900, 2, 3), (4000000000, 1 << 30, 4095, 1, 0)]
+
+
+def test_parser_resyncs_on_noise_and_bad_crc(lib) -> None:
+    good = [edm_client.encode_frame(0x10, seq, bytes([seq])) for seq in range(3)]
+    corrupt = bytearray(good[1])
+    corrupt[-3] ^= 0xFF
+    oversized = bytes([edm_client.SOF, 0x10, 0, 0xFF, 0xFF])
+    stream = b'I (10) main: boot\r\n\xa5' + good[0] + bytes(corrupt) + oversized + b'\xa5\xa5' + good[2] + good[1]
+
+    frames, crc_errors = c_feed(lib, stream)
+    assert [(t, s) for t, s, _ in frames] == [(0x10, 0), (0x10, 2), (0x10, 1)]
+    assert crc_errors >= 1
+
+    parser = edm_client.FrameParser()
+    py_frames = [f for chunk in (stream[:7], stream[7:50], stream[50:]) for f in parser.feed(chunk)]
+    assert [(f.type, f.seq, f.payload) for f in py_frames] == frames
+    assert parser.console.startswith(b'I (10) main: boot\r\n')
+
+
+def test_param_get_set(device) -> None:
+    assert device.ping(b'hello') == b'hello'
+    assert device.get_param('duty_percent') == 40
+    assert device.set_param('duty_percent', 55) == 55
+    assert device.get_param('duty_percent') == 55
+    assert device.set_param('gap_low', 600) == 600
+    with pytest.raises(edm_client.NackError) as e:
+        device.set_param('gap_high', 300)  # below gap_low
+    assert e.value.reason == 4
+    with pytest.raises(edm_client.NackError) as e:
+        device.set_param('duty_percent', 101)
+    assert e.value.reason == 4
+    assert device.set_param('cut_speed_um_s', 40) == 40
+    with pytest.raises(edm_client.NackError) as e:
+        device.set_param('cut_speed_um_s', 30)  # below 2 Hz, the slowest step the uniform encoder holds
+    assert e.value.reason == 4
+    with pytest.raises(edm_client.NackError) as e:
+        device.request(edm_client.MSG_GET_PARAM, b'\x63')
+    assert e.value.reason == 3
+    with pytest.raises(edm_client.NackError) as e:
+        device.request(0x55)
+    assert e.value.reason == 1
+
+
+def test_trip_counters_and_clear(device) -> None:
+    assert device.get_param('trip_count') == 3
+    assert device.get_param('trip_cbc_cycles') == 7
+    assert device.get_param('trip_ost_latches') == 1
+    assert device.get_param('trip_latched') == 1
+    with pytest.raises(edm_client.NackError) as e:
+        device.set_param('trip_count', 0)
+    assert e.value.reason == 7
+    device.clear_trip()
+    assert device.get_param('trip_latched') == 0
+    assert device.get_param('trip_ost_latches') == 1  # counters survive the clear
+
+
+def test_commands(device) -> None:
+    device.jog(-200)
+    device.start()
+    with pytest.raises(edm_client.NackError) as e:
+        device.jog(50)
+    assert e.value.reason == 6  # busy while cutting
+    device.stop()
+    device.jog(50)
+    with pytest.raises(edm_client.NackError):
+        device.command(0x44)
+
+
+def test_batched_telemetry(device) -> None:
+    assert device.set_param('telemetry_hz', 40) == 40
+    device.poll(1.5)
+    samples, frames = device.telemetry, device.telemetry_frames
+    assert 40 <= len(samples) <= 65
+    # Batches of up to 8 records, flushed at least every 100 ms
+    assert len(samples) / frames >= 3
+    assert frames >= len(samples) / 8
+    times = [s.time_ms for s in samples]
+    assert times == sorted(times)
+    # Console log lines are interleaved with the frames and skipped
+    assert b'main: EDM' in device.parser.console
+    assert device.parser.crc_errors == 0
+
+    assert device.set_param('telemetry_hz', 0) == 0
+    device.poll(0.3)
+    count = len(device.telemetry)
+    device.poll(0.5)
+    assert len(device.telemetry) == count
+    with pytest.raises(edm_client.NackError):
+        device.set_param('telemetry_hz', 1000)
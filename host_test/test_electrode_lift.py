@@ -0,0 +1,129 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import random
+
+import pytest
+
+SERVO_TICK_MS = 20  # vTaskDelay in the cut branch of stepper_task
+
+
+class LiftConfig(ctypes.Structure):
+    _fields_ = [('period_ms', ctypes.c_uint32),
+                ('min_period_ms', ctypes.c_uint32),
+                ('short_rate_full_permille', ctypes.c_uint32),
+                ('rate_filter_shift', ctypes.c_uint32)]
+
+
+class Lift(ctypes.Structure):
+    _fields_ = [('config', LiftConfig),
+                ('short_rate_q16', ctypes.c_uint32),
+                ('last_lift_ms', ctypes.c_uint32),
+                ('lifts', ctypes.c_uint32)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('electrode_lift.c', name='electrode_lift')
+    lib.electrode_lift_init.argtypes = [ctypes.POINTER(Lift), ctypes.POINTER(LiftConfig), ctypes.c_uint32]
+    lib.electrode_lift_note_gap.argtypes = [ctypes.POINTER(Lift), ctypes.c_bool]
+    lib.electrode_lift_period_ms.argtypes = [ctypes.POINTER(Lift)]
+    lib.electrode_lift_period_ms.restype = ctypes.c_uint32
+    lib.electrode_lift_due.argtypes = [ctypes.POINTER(Lift), ctypes.c_uint32]
+    lib.electrode_lift_due.restype = ctypes.c_bool
+    lib.electrode_lift_done.argtypes = [ctypes.POINTER(Lift), ctypes.c_uint32]
+    return lib
+
+
+def make_lift(lib, period_ms: int, min_period_ms: int = 500, now_ms: int = 0) -> Lift:
+    lift = Lift()
+    config = LiftConfig(period_ms, min_period_ms, 300, 4)  # defaults from main.c
+    lib.electrode_lift_init(ctypes.byref(lift), ctypes.byref(config), now_ms)
+    return lift
+
+
+def simulate_cut(lib, period_ms: int, min_period_ms: int = 500, seconds: int = 120, seed: int = 7) -> dict:
+    """Debris model of a deep cut, driven by the firmware lift scheduler.
+
+    Every servo tick removes material in proportion to how clean the gap is. Removal adds debris,
+    and natural flushing gets weaker with depth. Debris raises the chance that a tick is a
+    short/arc, which removes nothing. A lift pumps most of the debris out but costs the time to
+    retract and plunge 0.5 mm at the main.c speeds.
+    """
+    rng = random.Random(seed)
+    lift = make_lift(lib, period_ms, min_period_ms)
+    lift_time_ms = round(0.5 / 20 * 1000 + 0.5 / 10 * 1000)  # retract at 20 mm/s, plunge at 10 mm/s
+    depth_mm, debris, removed, shorts, ticks, now_ms = 5.0, 0.0, 0.0, 0, 0, 0
+    while now_ms < seconds * 1000:
+        short = rng.random() < min(0.95, 1.5 * debris)
+        if short:
+            shorts += 1
+        else:
+            step = 0.0002 * (1.0 - debris)
+            removed += step
+            depth_mm += step
+            debris = min(1.0, debris + 60.0 * step)
+        debris *= 1.0 - 0.02 / (1.0 + depth_mm)  # natural flushing fades with depth
+        ticks += 1
+        lib.electrode_lift_note_gap(ctypes.byref(lift), short)
+        now_ms += SERVO_TICK_MS
+        if lib.electrode_lift_due(ctypes.byref(lift), now_ms):
+            now_ms += lift_time_ms
+            debris *= 0.2
+            lib.electrode_lift_done(ctypes.byref(lift), now_ms)
+    return {
+        'removal_mm_per_min': removed / seconds * 60,
+        'short_rate': shorts / ticks,
+        'lifts': lift.lifts,
+    }
+
+
+def test_disabled_never_lifts(lib) -> None:
+    lift = make_lift(lib, 0)
+    assert not lib.electrode_lift_due(ctypes.byref(lift), 10 ** 6)
+
+
+def test_fixed_period(lib) -> None:
+    lift = make_lift(lib, 2000, now_ms=1000)
+    assert not lib.electrode_lift_due(ctypes.byref(lift), 2999)
+    assert lib.electrode_lift_due(ctypes.byref(lift), 3000)
+    lib.electrode_lift_done(ctypes.byref(lift), 3100)
+    assert not lib.electrode_lift_due(ctypes.byref(lift), 5099)
+    assert lib.electrode_lift_due(ctypes.byref(lift), 5100)
+    assert lift.lifts == 1
+
+
+def test_period_survives_tick_wraparound(lib) -> None:
+    lift = make_lift(lib, 2000, now_ms=0xFFFFFF00)
+    assert not lib.electrode_lift_due(ctypes.byref(lift), 0x00000100)
+    assert lib.electrode_lift_due(ctypes.byref(lift), 0x00000700)
+
+
+def test_period_shortens_with_short_rate(lib) -> None:
+    lift = make_lift(lib, 2000, 500)
+    assert lib.electrode_lift_period_ms(ctypes.byref(lift)) == 2000
+    previous = 2000
+    for _ in range(8):
+        lib.electrode_lift_note_gap(ctypes.byref(lift), True)
+        period = lib.electrode_lift_period_ms(ctypes.byref(lift))
+        assert period <= previous
+        previous = period
+    assert previous < 2000
+    for _ in range(100):
+        lib.electrode_lift_note_gap(ctypes.byref(lift), True)
+    assert lib.electrode_lift_period_ms(ctypes.byref(lift)) == 500
+    for _ in range(300):
+        lib.electrode_lift_note_gap(ctypes.byref(lift), False)
+    assert lib.electrode_lift_period_ms(ctypes.byref(lift)) > 1900
+
+
+def test_lifting_improves_removal_rate(lib) -> None:
+    without = simulate_cut(lib, period_ms=0)
+    fixed = simulate_cut(lib, period_ms=2000, min_period_ms=2000)
+    adaptive = simulate_cut(lib, period_ms=2000, min_period_ms=500)
+    for name, result in (('no lift', without), ('fixed 2 s', fixed), ('adaptive 2-0.5 s', adaptive)):
+        print('{:<18} removal {:.4f} mm/min  short rate {:.2f}  lifts {}'.format(
+            name, result['removal_mm_per_min'], result['short_rate'], result['lifts']))
+    assert without['lifts'] == 0
+    assert fixed['removal_mm_per_min'] > 1.5 * without['removal_mm_per_min']
+    assert adaptive['removal_mm_per_min'] >= fixed['removal_mm_per_min']
+    assert adaptive['lifts'] > fixed['lifts']
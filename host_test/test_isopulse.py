@@ -0,0 +1,146 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import random
+from typing import Optional, Tuple
+
+import pytest
+
+RESOLUTION_HZ = 10000000  # PWM_RESOLUTION_HZ in MCPWM_task.c
+
+
+class IsopulseParams(ctypes.Structure):
+    _fields_ = [('on_time_ns', ctypes.c_uint32),
+                ('off_time_ns', ctypes.c_uint32),
+                ('max_ignition_delay_ns', ctypes.c_uint32)]
+
+
+class IsopulseTiming(ctypes.Structure):
+    _fields_ = [('sync_phase_ticks', ctypes.c_uint32),
+                ('compare_ticks', ctypes.c_uint32),
+                ('period_ticks', ctypes.c_uint32)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('isopulse.c', name='isopulse')
+    lib.isopulse_compute_timing.argtypes = [ctypes.POINTER(IsopulseParams), ctypes.c_uint32, ctypes.POINTER(IsopulseTiming)]
+    lib.isopulse_compute_timing.restype = ctypes.c_bool
+    return lib
+
+
+def compute(lib, on_ns: int, off_ns: int, wait_ns: int) -> Optional[IsopulseTiming]:
+    timing = IsopulseTiming()
+    ok = lib.isopulse_compute_timing(ctypes.byref(IsopulseParams(on_ns, off_ns, wait_ns)), RESOLUTION_HZ, ctypes.byref(timing))
+    return timing if ok else None
+
+
+def simulate_period(period: int, compare: int, sync_phase: Optional[int], edges, gated: bool = True) -> Tuple[int, int]:
+    """Tick model of one MCPWM up-counting period as configured by mcpwm_halfbridge_task.
+
+    PWM0A goes high on TEZ and low on the compare event. edges are the ticks of rising edges on the
+    capture pin (one tick, a list, or None). An edge loads sync_phase into the counter whatever the
+    output state (no sync when sync_phase is None). With gated, as in the firmware, only the first
+    edge of the period syncs; capture ISR latency is not modelled. The gap conducts from the first
+    edge while PWM0A is high until PWM0A goes low.
+    Returns (discharge ticks, period length in ticks).
+    """
+    edges = set() if edges is None else {edges} if isinstance(edges, int) else set(edges)
+    counter = 0
+    elapsed = 0
+    output_high = True
+    ignited_at = None
+    discharge = 0
+    sync_armed = sync_phase is not None
+    while True:
+        if output_high and counter == compare:
+            output_high = False
+            if ignited_at is not None:
+                discharge = elapsed - ignited_at
+        if elapsed in edges:
+            edges.discard(elapsed)
+            if output_high and ignited_at is None:
+                ignited_at = elapsed
+            if sync_armed:
+                sync_armed = not gated
+                counter = sync_phase
+                continue
+        counter += 1
+        elapsed += 1
+        if counter == period:
+            return discharge, elapsed
+
+
+def ignition_delays(seed: int, mean_ticks: int, count: int):
+    rng = random.Random(seed)
+    for _ in range(count):
+        yield int(rng.expovariate(1.0 / mean_ticks))
+
+
+def test_timing_layout(lib) -> None:
+    timing = compute(lib, 5000, 20000, 50000)
+    assert (timing.sync_phase_ticks, timing.compare_ticks, timing.period_ticks) == (500, 550, 750)
+
+
+def test_timing_rejects_unrealisable_settings(lib) -> None:
+    assert compute(lib, 0, 20000, 50000) is None
+    assert compute(lib, 5000, 0, 50000) is None
+    assert compute(lib, 5000, 20000, 0) is None
+    assert compute(lib, 5000, 20000, 7000000) is None  # beyond the 16 bit timer
+    assert compute(lib, 20, 20000, 50000) is None  # rounds to zero ticks
+
+
+@pytest.mark.parametrize('mean_delay_us', [2, 10, 30])
+def test_discharge_duration_constant_across_ignition_delay(lib, mean_delay_us: int) -> None:
+    timing = compute(lib, 5000, 20000, 50000)
+    on_ticks = timing.compare_ticks - timing.sync_phase_ticks
+    off_ticks = timing.period_ticks - timing.compare_ticks
+    ignited = 0
+    for delay in ignition_delays(mean_delay_us, mean_delay_us * 10, 300):
+        # No breakdown edge once the high side is off
+        edge = delay if delay < timing.compare_ticks else None
+        discharge, length = simulate_period(timing.period_ticks, timing.compare_ticks, timing.sync_phase_ticks, edge)
+        if edge is not None:
+            ignited += 1
+            assert discharge == on_ticks
+            assert length == delay + on_ticks + off_ticks
+        else:
+            # Never ignited while on: open-circuit pulse, period runs out unchanged
+            assert discharge == 0
+            assert length == timing.period_ticks
+    assert ignited > 0
+
+
+def test_isofrequency_discharge_varies_with_ignition_delay(lib) -> None:
+    # Same simulator without the sync: the fixed 20 kHz / 40 % pattern this mode replaces
+    period = RESOLUTION_HZ // 20000
+    compare = period * 40 // 100
+    discharges = {simulate_period(period, compare, None, delay)[0] for delay in ignition_delays(1, 50, 200) if delay < compare}
+    assert len(discharges) > 10
+
+
+def test_late_ignition_still_gets_full_pulse(lib) -> None:
+    # Breakdown after the wait window but before the open-circuit pulse ends
+    timing = compute(lib, 5000, 20000, 50000)
+    delay = timing.sync_phase_ticks + 10
+    discharge, _ = simulate_period(timing.period_ticks, timing.compare_ticks, timing.sync_phase_ticks, delay)
+    assert discharge == timing.compare_ticks - timing.sync_phase_ticks
+
+
+def test_restrike_keeps_on_time(lib) -> None:
+    timing = compute(lib, 5000, 20000, 50000)
+    on_ticks = timing.compare_ticks - timing.sync_phase_ticks
+    discharge, _ = simulate_period(timing.period_ticks, timing.compare_ticks, timing.sync_phase_ticks, [100, 120])
+    assert discharge == on_ticks
+    # Without the gate the second edge would reload the counter and stretch the discharge
+    discharge, _ = simulate_period(timing.period_ticks, timing.compare_ticks, timing.sync_phase_ticks, [100, 120], gated=False)
+    assert discharge == 20 + on_ticks
+
+
+def test_edge_in_pause_ignored_after_breakdown(lib) -> None:
+    timing = compute(lib, 5000, 20000, 50000)
+    on_ticks = timing.compare_ticks - timing.sync_phase_ticks
+    off_ticks = timing.period_ticks - timing.compare_ticks
+    pause_edge = 100 + on_ticks + 50
+    discharge, length = simulate_period(timing.period_ticks, timing.compare_ticks, timing.sync_phase_ticks, [100, pause_edge])
+    assert discharge == on_ticks
+    assert length == 100 + on_ticks + off_ticks
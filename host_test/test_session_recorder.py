@@ -0,0 +1,217 @@
+# SPDX-License-Identifier: CC0-1.0
+import csv
+import ctypes
+import os
+import random
+import sys
+
+import pytest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools'))
+import session_decode  # noqa: E402
+
+BLOCK_SIZE = 256
+SECTOR_SIZE = 4096
+SAMPLE_INTERVAL_MS = 100  # SESSION_SAMPLE_INTERVAL_MS in session_recorder.c
+ERASE_AHEAD_SECTORS = 128  # SESSION_ERASE_AHEAD_SECTORS in session_recorder.c
+
+
+class SessionSample(ctypes.Structure):
+    _fields_ = [('time_ms', ctypes.c_uint32),
+                ('position_steps', ctypes.c_int32),
+                ('gap_adc', ctypes.c_uint16),
+                ('servo', ctypes.c_int8),
+                ('pulse_class', ctypes.c_uint8)]
+
+
+class SessionBlock(ctypes.Structure):
+    _fields_ = [('data', ctypes.c_uint8 * BLOCK_SIZE),
+                ('payload_len', ctypes.c_uint16),
+                ('count', ctypes.c_uint8),
+                ('last', SessionSample)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('session_block.c', 'crc16.c', name='session_block')
+    lib.session_block_begin.argtypes = [ctypes.POINTER(SessionBlock), ctypes.c_uint32, ctypes.c_uint8, ctypes.POINTER(SessionSample)]
+    lib.session_block_append.argtypes = [ctypes.POINTER(SessionBlock), ctypes.POINTER(SessionSample)]
+    lib.session_block_append.restype = ctypes.c_bool
+    lib.session_block_finish.argtypes = [ctypes.POINTER(SessionBlock)]
+    lib.session_block_valid.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_uint32)]
+    lib.session_block_valid.restype = ctypes.c_bool
+    return lib
+
+
+def cut_samples(seconds: int, seed: int = 3, start_ms: int = 5000):
+    """Decimated servo stream: gap drifting around the window, slow feed, a lift every 2 s"""
+    rng = random.Random(seed)
+    gap, position = 1200, 0
+    for i in range(seconds * 1000 // SAMPLE_INTERVAL_MS):
+        gap = max(0, min(4095, gap + rng.randint(-60, 60)))
+        servo = -1 if gap < 500 else (1 if gap > 2000 else rng.choice((0, 0, 1)))
+        if i % 20 == 19:
+            servo = 2
+        position += servo if servo != 2 else 0
+        pulse = 3 if gap < 250 else 2 if gap < 500 else 0 if gap > 2000 else 1
+        yield (start_ms + i * SAMPLE_INTERVAL_MS, position, gap, servo, pulse)
+
+
+class RecorderModel:
+    """Mirror of the writer task in session_recorder.c, writing into a bytearray partition"""
+
+    def __init__(self, lib, size: int) -> None:
+        self.lib = lib
+        self.image = bytearray(b'\xff' * size)
+        self.offset = 0
+        self.seq = 0
+        self.block = SessionBlock()
+        self.open = False
+        self.pending_flags = 0
+        self.blocks_written = 0
+        self.blocks_dropped = 0
+        self.sectors_erased = 0
+        self.erased_bytes = 0
+        self.erase_ahead_limit = min(ERASE_AHEAD_SECTORS * SECTOR_SIZE, size // 2)
+        self.cut_active = False
+
+    def idle(self) -> None:
+        """Queue timeouts between cuts, until the erased reserve is full"""
+        while not self.cut_active and self.erased_bytes < self.erase_ahead_limit:
+            offset = (self.offset + self.erased_bytes) % len(self.image)
+            self.image[offset:offset + SECTOR_SIZE] = b'\xff' * SECTOR_SIZE
+            self.sectors_erased += 1
+            self.erased_bytes += SECTOR_SIZE
+
+    def _write(self) -> None:
+        self.lib.session_block_finish(ctypes.byref(self.block))
+        if self.erased_bytes < BLOCK_SIZE:
+            self.blocks_dropped += 1
+            return
+        assert self.image[self.offset:self.offset + BLOCK_SIZE] == b'\xff' * BLOCK_SIZE
+        self.image[self.offset:self.offset + BLOCK_SIZE] = bytes(self.block.data)
+        self.offset = (self.offset + BLOCK_SIZE) % len(self.image)
+        self.erased_bytes -= BLOCK_SIZE
+        self.blocks_written += 1
+
+    def session_start(self) -> None:
+        self.cut_active = True
+        if self.open:
+            self._write()
+            self.open = False
+        self.pending_flags = session_decode.FLAG_SESSION_START
+
+    def log(self, sample: tuple) -> None:
+        self.cut_active = True
+        s = SessionSample(*sample)
+        if self.open and self.lib.session_block_append(ctypes.byref(self.block), ctypes.byref(s)):
+            return
+        if self.open:
+            self._write()
+        self.lib.session_block_begin(ctypes.byref(self.block), self.seq, self.pending_flags, ctypes.byref(s))
+        self.seq += 1
+        self.pending_flags = 0
+        self.open = True
+
+    def flush(self) -> None:
+        self.cut_active = False
+        if self.open:
+            self._write()
+            self.open = False
+
+
+def record(lib, sessions, size: int = 64 * 1024) -> RecorderModel:
+    model = RecorderModel(lib, size)
+    model.idle()  # after boot
+    for samples in sessions:
+        model.session_start()
+        erased = model.sectors_erased
+        for sample in samples:
+            model.log(sample)
+        model.flush()
+        assert model.sectors_erased == erased  # a cut only writes blocks
+        model.idle()
+    return model
+
+
+def test_round_trip_across_sessions(lib) -> None:
+    first = list(cut_samples(60, seed=1))
+    second = list(cut_samples(30, seed=2, start_ms=200000))
+    model = record(lib, [first, second])
+    decoded = session_decode.read_samples(bytes(model.image))
+    assert [s[1:] for s in decoded] == first + second
+    assert [s.session for s in decoded] == [1] * len(first) + [2] * len(second)
+
+
+def test_ring_rotation_keeps_newest_blocks(lib) -> None:
+    sessions = [list(cut_samples(120, seed=i, start_ms=i * 200000)) for i in range(8)]
+    model = record(lib, sessions, size=16 * 1024)
+    assert model.blocks_written > 16 * 1024 // BLOCK_SIZE  # wrapped at least once
+    assert model.blocks_dropped == 0
+    samples = [s for session in sessions for s in session]
+    decoded = session_decode.read_samples(bytes(model.image))
+    tail = [s[1:] for s in decoded]
+    # Oldest surviving sample onwards must match the input exactly, in order
+    start = samples.index(tail[0])
+    assert tail == samples[start:]
+    assert len(tail) > len(sessions[-1])
+
+
+def test_cut_longer_than_reserve_drops_blocks(lib) -> None:
+    samples = list(cut_samples(900))
+    model = record(lib, [samples], size=16 * 1024)
+    # Half of the 16 KB ring is erased ahead, the cut writes that much and drops the rest
+    assert model.blocks_written == 8 * 1024 // BLOCK_SIZE
+    assert model.blocks_dropped > 0
+    decoded = [s[1:] for s in session_decode.read_samples(bytes(model.image))]
+    assert decoded == samples[:len(decoded)]
+    # The next cut finds a full reserve again
+    model.session_start()
+    erased = model.sectors_erased
+    model.log(samples[0])
+    model.flush()
+    assert model.sectors_erased == erased and model.blocks_written == 8 * 1024 // BLOCK_SIZE + 1
+
+
+def test_corrupt_block_is_skipped(lib) -> None:
+    model = record(lib, [list(cut_samples(60))])
+    image = bytearray(model.image)
+    image[BLOCK_SIZE + 40] ^= 0x01
+    assert not lib.session_block_valid(bytes(image[BLOCK_SIZE:2 * BLOCK_SIZE]), None)
+    seq = ctypes.c_uint32()
+    assert lib.session_block_valid(bytes(image[:BLOCK_SIZE]), ctypes.byref(seq)) and seq.value == 0
+    blocks = session_decode.read_blocks(bytes(image))
+    assert [b.seq for b in blocks] == [b for b in range(model.blocks_written) if b != 1]
+
+
+def test_write_cost_per_second_of_cut(lib) -> None:
+    seconds = 600
+    model = record(lib, [list(cut_samples(seconds))], size=1024 * 1024)
+    bytes_per_s = model.blocks_written * BLOCK_SIZE / seconds
+    erases_per_hour = model.blocks_written * BLOCK_SIZE / SECTOR_SIZE / seconds * 3600  # sectors used up, erased between cuts
+    print('write cost: {:.1f} B/s, {:.3f} blocks/s, {:.0f} sector erases/h'.format(
+        bytes_per_s, model.blocks_written / seconds, erases_per_hour))
+    # Figures documented in session_recorder.c
+    assert bytes_per_s <= 50
+    assert erases_per_hour <= 45
+
+
+def test_csv_and_summary(lib, tmp_path) -> None:
+    samples = list(cut_samples(20))
+    model = record(lib, [samples])
+    image_path = tmp_path / 'cutlog.bin'
+    image_path.write_bytes(bytes(model.image))
+    csv_path = tmp_path / 'cutlog.csv'
+    assert session_decode.main([str(image_path), '-o', str(csv_path)]) == 0
+    with open(csv_path) as f:
+        rows = list(csv.DictReader(f))
+    assert len(rows) == len(samples)
+    assert rows[0]['gap_adc'] == str(samples[0][2])
+    assert rows[19]['servo'] == 'lift'
+
+    summary = session_decode.summarize(session_decode.read_samples(bytes(model.image)))
+    assert len(summary) == 1
+    assert summary[0]['samples'] == len(samples)
+    assert summary[0]['duration_s'] == pytest.approx((len(samples) - 1) * SAMPLE_INTERVAL_MS / 1000)
+    assert summary[0]['servo']['lift'] == len(samples) // 20
+    assert summary[0]['gap_max'] == max(s[2] for s in samples)
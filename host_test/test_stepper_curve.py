@@ -0,0 +1,153 @@
+# SPDX-License-Identifier: CC0-1.0
+import ctypes
+import subprocess
+
+import pytest
+
+SLOTS = 3
+UNIFORM_MAX_SYMBOLS = 8  # STEPPER_UNIFORM_MAX_SYMBOLS
+
+
+class CurveConfig(ctypes.Structure):
+    _fields_ = [('resolution', ctypes.c_uint32),
+                ('sample_points', ctypes.c_uint32),
+                ('start_freq_hz', ctypes.c_uint32),
+                ('end_freq_hz', ctypes.c_uint32)]
+
+
+class Curve(ctypes.Structure):
+    _fields_ = [('storage', ctypes.POINTER(ctypes.c_uint32)),
+                ('max_points', ctypes.c_uint32),
+                ('points', ctypes.c_uint32 * SLOTS),
+                ('is_accel', ctypes.c_bool * SLOTS),
+                ('back', ctypes.c_uint32),
+                ('front', ctypes.c_uint32),
+                ('handoff', ctypes.c_uint32)]
+
+
+@pytest.fixture(scope='module')
+def lib(load_host_lib):
+    lib = load_host_lib('stepper_curve.c', name='stepper_curve')
+    lib.stepper_curve_init.argtypes = [ctypes.POINTER(Curve), ctypes.POINTER(ctypes.c_uint32), ctypes.c_uint32, ctypes.POINTER(CurveConfig)]
+    lib.stepper_curve_init.restype = ctypes.c_bool
+    lib.stepper_curve_prepare.argtypes = [ctypes.POINTER(Curve), ctypes.POINTER(CurveConfig)]
+    lib.stepper_curve_prepare.restype = ctypes.c_bool
+    lib.stepper_curve_publish.argtypes = [ctypes.POINTER(Curve)]
+    lib.stepper_curve_begin.argtypes = [ctypes.POINTER(Curve)]
+    lib.stepper_curve_symbols.argtypes = [ctypes.POINTER(Curve), ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+    lib.stepper_curve_symbols.restype = ctypes.POINTER(ctypes.c_uint32)
+    lib.stepper_uniform_symbols.argtypes = [ctypes.c_uint32, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+    lib.stepper_uniform_symbols.restype = ctypes.c_uint32
+    return lib
+
+
+def durations(lib, curve, steps):
+    count = ctypes.c_uint32()
+    symbols = lib.stepper_curve_symbols(ctypes.byref(curve), steps, ctypes.byref(count))
+    # rmt_symbol_word_t: low half level 0, high half level 1, same duration
+    assert all(symbols[i] >> 16 == (symbols[i] & 0xFFFF) | 0x8000 for i in range(count.value))
+    return [symbols[i] & 0x7FFF for i in range(count.value)]
+
+
+def make_curve(lib, max_points, config):
+    curve = Curve()
+    storage = (ctypes.c_uint32 * (SLOTS * max_points))()
+    assert lib.stepper_curve_init(ctypes.byref(curve), storage, max_points, ctypes.byref(config))
+    curve._storage = storage  # keep alive
+    return curve
+
+
+def test_tables_match_encoder_curves(lib) -> None:
+    accel = make_curve(lib, 500, CurveConfig(1000000, 500, 500, 1500))
+    lib.stepper_curve_begin(ctypes.byref(accel))
+    d = durations(lib, accel, 500)
+    assert d[0] == 1000 and d[-1] == pytest.approx(1000000 / 1500 / 2, abs=1)
+    assert d == sorted(d, reverse=True)
+    assert durations(lib, accel, 10) == d[:10]  # acceleration plays from the start
+
+    decel = make_curve(lib, 500, CurveConfig(1000000, 500, 1500, 500))
+    lib.stepper_curve_begin(ctypes.byref(decel))
+    assert durations(lib, decel, 500) == d[::-1]
+    assert durations(lib, decel, 10) == d[::-1][-10:]  # deceleration plays out to the end
+    assert len(durations(lib, decel, 900)) == 500  # clamped to the table
+
+
+def test_invalid_configs_rejected(lib) -> None:
+    curve = make_curve(lib, 64, CurveConfig(1000000, 10, 3000, 2990))
+    for bad in (CurveConfig(1000000, 65, 3000, 2000),  # more than max points
+                CurveConfig(1000000, 10, 3000, 3000),
+                CurveConfig(1000000, 10, 3000, 2995),  # frequency span below sample points
+                CurveConfig(1000000, 1, 3000, 2000),
+                CurveConfig(0, 10, 3000, 2000),
+                CurveConfig(1000000, 10, 15, 100),  # 33333 ticks per half period, above 0x7FFF
+                CurveConfig(1000000, 10, 100, 15),
+                CurveConfig(10000000, 10, 150, 1000)):
+        assert not lib.stepper_curve_prepare(ctypes.byref(curve), ctypes.byref(bad))
+    slowest = CurveConfig(1000000, 10, 16, 100)  # 31250 ticks, the slowest that fits
+    assert lib.stepper_curve_prepare(ctypes.byref(curve), ctypes.byref(slowest))
+
+
+def uniform_halves(lib, resolution, freq_hz):
+    symbols = (ctypes.c_uint32 * UNIFORM_MAX_SYMBOLS)()
+    count = lib.stepper_uniform_symbols(resolution, freq_hz, symbols)
+    halves = []
+    for i in range(count):
+        halves += [(symbols[i] >> 15 & 1, symbols[i] & 0x7FFF), (symbols[i] >> 31, symbols[i] >> 16 & 0x7FFF)]
+    return halves
+
+
+def test_uniform_step_splits_long_half_periods(lib) -> None:
+    # Fast steps stay one symbol, same as before the split
+    assert uniform_halves(lib, 1000000, 2000) == [(0, 250), (1, 250)]
+    # 5 Hz (0.1 mm/s feed): 100000 ticks per half period, 4 pieces of 25000 each
+    assert uniform_halves(lib, 1000000, 5) == [(0, 25000)] * 4 + [(1, 25000)] * 4
+    # Odd piece count: the middle symbol holds the level change
+    halves = uniform_halves(lib, 1000000, 6)
+    assert halves == [(0, 27778), (0, 27778), (0, 27777), (1, 27778), (1, 27778), (1, 27777)]
+    for freq in (2, 3, 7, 15, 16, 17, 1000):
+        halves = uniform_halves(lib, 1000000, freq)
+        assert all(0 < ticks <= 0x7FFF for _, ticks in halves)
+        assert sum(ticks for level, ticks in halves if level == 0) == 1000000 // freq // 2
+        assert sum(ticks for level, ticks in halves if level == 1) == 1000000 // freq // 2
+
+
+def test_uniform_step_range(lib) -> None:
+    assert uniform_halves(lib, 1000000, 1) == []  # 500000 ticks, more than 8 symbols
+    assert uniform_halves(lib, 1000000, 0) == []
+    assert uniform_halves(lib, 1000000, 500001) == []
+    assert len(uniform_halves(lib, 1000000, 2)) == 2 * UNIFORM_MAX_SYMBOLS
+
+
+def test_swap_only_at_transaction_start(lib) -> None:
+    curve = make_curve(lib, 64, CurveConfig(1000000, 10, 3000, 2990))
+    lib.stepper_curve_begin(ctypes.byref(curve))
+    before = durations(lib, curve, 10)
+    assert before[0] == 166
+
+    assert lib.stepper_curve_prepare(ctypes.byref(curve), ctypes.byref(CurveConfig(1000000, 20, 1000, 980)))
+    assert durations(lib, curve, 10) == before  # prepared only
+    lib.stepper_curve_publish(ctypes.byref(curve))
+    assert durations(lib, curve, 10) == before  # transaction in flight keeps its table
+    lib.stepper_curve_begin(ctypes.byref(curve))
+    after = durations(lib, curve, 100)
+    assert len(after) == 20 and after[0] == 500
+
+    # Two publishes before the next transaction: the newest wins
+    for freq in (2000, 4000):
+        assert lib.stepper_curve_prepare(ctypes.byref(curve), ctypes.byref(CurveConfig(1000000, 10, freq, freq - 10)))
+        lib.stepper_curve_publish(ctypes.byref(curve))
+    lib.stepper_curve_begin(ctypes.byref(curve))
+    assert durations(lib, curve, 10)[0] == 125
+    lib.stepper_curve_begin(ctypes.byref(curve))  # nothing new published
+    assert durations(lib, curve, 10)[0] == 125
+
+
+def test_swap_under_concurrent_transmits(build_host) -> None:
+    harness = build_host('stepper_curve_swap.c', 'stepper_curve.c', name='stepper_curve_swap', shared=False, extra_flags=('-pthread',))
+    for _ in range(3):
+        result = subprocess.run([harness], capture_output=True, text=True, timeout=60)
+        print(result.stdout, result.stderr)
+        assert result.returncode == 0
+        stats = dict(item.split('=') for item in result.stdout.split())
+        assert int(stats['torn']) == 0 and int(stats['regressions']) == 0
+        assert int(stats['distinct']) > 1
@@ -1,4 +1,5 @@
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
 #include "freertos/FreeRTOS.h"
@@ -10,8 +11,10 @@ static const char *TAG = "adc_cali";
 extern SemaphoreHandle_t capture_semaphore;
 adc_oneshot_unit_handle_t adc_handle = NULL;
 volatile int adc_value_on_capture = 0;
+volatile bool adc_filter_hold = false; // Set while the electrode is lifted, keeps the pre-lift gap reading
 
 #define FILTER_WINDOW 8 // Number of samples for moving average
+#define CURRENT_SENSE_CHANNEL ADC_CHANNEL_7 // GPIO35, discharge current peak hold
 
 // ADC filtering and capture task
 void adc_on_capture_task(void *pvParameters)
@@ -22,7 +25,7 @@ void adc_on_capture_task(void *pvParameters)
     const int MAX_JUMP = 200; // Max allowed jump between samples
     while (1) {
       //  ESP_LOGI(TAG, "ADC task running, waiting for capture_semaphore...");
-        if (capture_semaphore && xSemaphoreTake(capture_semaphore, pdMS_TO_TICKS(100)) == pdTRUE) {
+        if (capture_semaphore && xSemaphoreTake(capture_semaphore, pdMS_TO_TICKS(100)) == pdTRUE && !adc_filter_hold) {
             int value = 0;
             esp_err_t err = adc_oneshot_read(adc_handle, ADC_CHANNEL_6, &value);
            // ESP_LOGI(TAG, "ADC raw read: %d (err=%s)", value, esp_err_to_name(err));
@@ -49,6 +52,12 @@ void adc_on_capture_task(void *pvParameters)
     }
 }
 
+// Raw current sense sample for the TEZ current loop in MCPWM_task.c
+bool IRAM_ATTR adc_current_sense_read_isr(int *out_raw)
+{
+    return adc_handle && adc_oneshot_read_isr(adc_handle, CURRENT_SENSE_CHANNEL, out_raw) == ESP_OK;
+}
+
 // Only keep calibration init and deinit functions, as used in main.c
 bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle)
 {
@@ -131,5 +140,11 @@ void adc_oneshot_init(void)
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to configure ADC channel: %s", esp_err_to_name(err));
         adc_handle = NULL;
+        return;
+    }
+    err = adc_oneshot_config_channel(adc_handle, CURRENT_SENSE_CHANNEL, &chan_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure current sense channel: %s", esp_err_to_name(err));
+        adc_handle = NULL;
     }
 }
\ No newline at end of file
@@ -1,28 +1,93 @@
+#include <inttypes.h>
+#include <string.h>
 #include "driver/mcpwm_prelude.h"
+#include "hal/mcpwm_ll.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "esp_log.h"
 #include "freertos/semphr.h"
-#include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "overcurrent_trip.h"
+#include "isopulse.h"
+#include "current_regulator.h"
 
 #define MCPWM_GPIO_PWM0A   16
 #define MCPWM_GPIO_PWM0B   17
 #define MCPWM_CAP_GPIO   18  // External signal capture pin
+#define MCPWM_FAULT_GPIO 19  // Overcurrent comparator output, high = overcurrent
+#define MCPWM_TRIP_MODE  OVERCURRENT_TRIP_CYCLE_BY_CYCLE // or OVERCURRENT_TRIP_ONE_SHOT to latch until cleared
+#define PWM_TIMER_ID       0 // Group 0 hands out timer 0 first, this firmware creates a single timer
 #define PWM_FREQ_HZ        20000
+#define PWM_RESOLUTION_HZ  10000000 // 0.1us per tick
 #define DEAD_TIME_NS       100
+#define CURRENT_LOOP_DIVIDER 4      // Regulator update every N PWM periods, 5 kHz at 20 kHz PWM
+#define CURRENT_SENSE_FULL_SCALE_MA 40000 // Peak current at ADC count 4095
 
 volatile int duty_percent = 40; // Start with 40%, change this variable from elsewhere
 volatile uint32_t last_pwm_rising_ticks = 0; // Timestamp of last PWM rising edge
 volatile uint32_t last_capture_ticks = 0;
 volatile uint32_t delay_ticks = 0; // Store the interval between PWM and capture
+
+// Isopulse mode: breakdown on MCPWM_CAP_GPIO syncs the timer so every discharge lasts exactly
+// the on time, instead of the fixed PWM_FREQ_HZ / duty_percent pattern
+volatile bool isopulse_enabled = false;
+// Settings and their timer values are only ever swapped together, see mcpwm_isopulse_publish()
+static portMUX_TYPE isopulse_lock = portMUX_INITIALIZER_UNLOCKED;
+static isopulse_params_t isopulse_params = { .on_time_ns = 5000, .off_time_ns = 20000, .max_ignition_delay_ns = 50000 };
+static isopulse_timing_t isopulse_timing = { .sync_phase_ticks = 500, .compare_ticks = 550, .period_ticks = 750 }; // at PWM_RESOLUTION_HZ
+// Closed loop peak current, duty_percent becomes the duty ceiling. 0 runs open loop at duty_percent.
+volatile uint32_t target_peak_current_ma = 0;
+volatile uint32_t measured_peak_current_ma = 0;
 SemaphoreHandle_t capture_semaphore = NULL;
 
+static const char *TAG = "mcpwm";
+
+extern bool adc_current_sense_read_isr(int *out_raw);
+
+// Publish a complete isopulse setting, timing computed by isopulse_compute_timing() at PWM_RESOLUTION_HZ
+void mcpwm_isopulse_publish(const isopulse_params_t *params, const isopulse_timing_t *timing)
+{
+    taskENTER_CRITICAL(&isopulse_lock);
+    isopulse_params = *params;
+    isopulse_timing = *timing;
+    taskEXIT_CRITICAL(&isopulse_lock);
+}
+
+void mcpwm_isopulse_get(isopulse_params_t *out_params, isopulse_timing_t *out_timing)
+{
+    taskENTER_CRITICAL(&isopulse_lock);
+    if (out_params) {
+        *out_params = isopulse_params;
+    }
+    if (out_timing) {
+        *out_timing = isopulse_timing;
+    }
+    taskEXIT_CRITICAL(&isopulse_lock);
+}
+
+// Inner current loop, runs from the TEZ interrupt while the isofrequency pattern is active
+static current_regulator_t current_regulator;
+static volatile bool current_loop_active = false;
+static volatile bool current_loop_ack = false; // Value the last TEZ callback acted on
+static volatile bool current_loop_restart = false;
+static uint32_t current_loop_period_ticks;
+
+// Breakdown gate (isopulse mode): the capture ISR turns the timer sync input off after the first
+// edge of a period, the TEZ callback turns it back on for the next ignition
+static volatile bool breakdown_gate_armed = false;
+static volatile bool breakdown_gate_ack = false; // Value the last TEZ callback acted on
+
 // Callback for PWM rising edge (when PWM0B goes HIGH)
 // Removed unused/incompatible PWM generator callback
 
 static bool IRAM_ATTR capture_cb(mcpwm_cap_channel_handle_t cap_chan, const mcpwm_capture_event_data_t *edata, void *user_data)
 {
-    // Only trigger the ADC task (e.g., by giving the semaphore)
+    if (breakdown_gate_armed) {
+        // One breakdown per period, re-strikes and ringing no longer reload the counter
+        mcpwm_ll_timer_enable_sync_input(MCPWM_LL_GET_HW(0), PWM_TIMER_ID, false);
+    }
+    // Trigger the ADC task (e.g., by giving the semaphore)
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     if (capture_semaphore) {
         xSemaphoreGiveFromISR(capture_semaphore, &xHigherPriorityTaskWoken);
@@ -33,7 +98,7 @@ static bool IRAM_ATTR capture_cb(mcpwm_cap_channel_handle_t cap_chan, const mcpw
     return false;
 }
 
-void setup_mcpwm_capture(mcpwm_timer_handle_t timer)
+mcpwm_cap_timer_handle_t setup_mcpwm_capture(mcpwm_timer_handle_t timer)
 {
     mcpwm_cap_timer_handle_t cap_timer = NULL;
     mcpwm_capture_timer_config_t cap_timer_config = {
@@ -57,6 +122,103 @@ void setup_mcpwm_capture(mcpwm_timer_handle_t timer)
         .on_cap = capture_cb,
     }, NULL));
     ESP_ERROR_CHECK(mcpwm_capture_channel_enable(cap_chan));
+    return cap_timer;
+}
+
+// One current loop update every CURRENT_LOOP_DIVIDER TEZ events
+static void IRAM_ATTR current_loop_run(mcpwm_cmpr_handle_t comparator)
+{
+    static uint32_t cycle;
+    static uint32_t last_cbc_cycles;
+    if (++cycle < CURRENT_LOOP_DIVIDER) {
+        return;
+    }
+    cycle = 0;
+    // Pulses cut by the brake since the last update say nothing about the compare value
+    uint32_t cbc_cycles = overcurrent_trip_cbc_cycles();
+    bool braked = cbc_cycles != last_cbc_cycles;
+    last_cbc_cycles = cbc_cycles;
+    if (current_loop_restart) {
+        current_loop_restart = false;
+        current_regulator_restart(&current_regulator);
+    }
+    int duty = duty_percent;
+    duty = duty < 0 ? 0 : duty > 100 ? 100 : duty;
+    uint32_t max_ticks = current_loop_period_ticks * duty / 100;
+    uint32_t target_ma = target_peak_current_ma;
+    uint32_t compare_ticks;
+    int raw;
+    if (target_ma == 0) {
+        compare_ticks = current_regulator_update_open_loop(&current_regulator, max_ticks);
+    } else if (adc_current_sense_read_isr(&raw)) {
+        measured_peak_current_ma = (uint32_t)raw * CURRENT_SENSE_FULL_SCALE_MA / 4095;
+        compare_ticks = braked ? current_regulator_update_braked(&current_regulator, target_ma, measured_peak_current_ma, max_ticks)
+                        : current_regulator_update(&current_regulator, target_ma, measured_peak_current_ma, max_ticks);
+    } else {
+        return; // ADC busy, keep the previous compare value
+    }
+    mcpwm_comparator_set_compare_value(comparator, compare_ticks);
+}
+
+// TEZ: the comparator value written here latches at the next TEZ. The current sense is a peak
+// hold, so the sample read here is the peak of the pulse that just ended.
+static bool IRAM_ATTR current_loop_on_empty(mcpwm_timer_handle_t timer, const mcpwm_timer_event_data_t *edata, void *user_data)
+{
+    bool gate = breakdown_gate_armed;
+    if (gate) {
+        mcpwm_ll_timer_enable_sync_input(MCPWM_LL_GET_HW(0), PWM_TIMER_ID, true);
+    }
+    breakdown_gate_ack = gate;
+    bool loop = current_loop_active;
+    if (loop) {
+        current_loop_run((mcpwm_cmpr_handle_t)user_data);
+    }
+    // Written after any compare update, so the task knows when the comparator is free
+    current_loop_ack = loop;
+    return false;
+}
+
+// Breakdown edge on the capture pin, routed to the timer sync input in hardware. The first rising
+// edge of a period reloads the counter, capture_cb() then disables the sync until the next TEZ.
+static mcpwm_sync_handle_t setup_breakdown_sync(void)
+{
+    mcpwm_sync_handle_t sync_src = NULL;
+    mcpwm_gpio_sync_src_config_t sync_config = {
+        .group_id = 0,
+        .gpio_num = MCPWM_CAP_GPIO,
+        .flags.active_neg = false, // same edge as the capture channel
+        .flags.pull_up = true,
+    };
+    ESP_ERROR_CHECK(mcpwm_new_gpio_sync_src(&sync_config, &sync_src));
+    return sync_src;
+}
+
+static esp_err_t apply_isopulse(mcpwm_timer_handle_t timer, mcpwm_cmpr_handle_t comparator, mcpwm_sync_handle_t sync_src,
+                                const isopulse_timing_t *timing)
+{
+    // Period and compare both latch on TEZ, so the switch happens on a period boundary
+    ESP_RETURN_ON_ERROR(mcpwm_timer_set_period(timer, timing->period_ticks), TAG, "set period failed");
+    ESP_RETURN_ON_ERROR(mcpwm_comparator_set_compare_value(comparator, timing->compare_ticks), TAG, "set compare failed");
+    mcpwm_timer_sync_phase_config_t phase_config = {
+        .sync_src = sync_src,
+        .count_value = timing->sync_phase_ticks,
+        .direction = MCPWM_TIMER_DIRECTION_UP,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_timer_set_phase_on_sync(timer, &phase_config), TAG, "set sync failed");
+    breakdown_gate_armed = true;
+    return ESP_OK;
+}
+
+static esp_err_t apply_isofrequency(mcpwm_timer_handle_t timer, uint32_t period_ticks)
+{
+    // The TEZ callback must not re-enable the sync input once it is removed
+    breakdown_gate_armed = false;
+    while (breakdown_gate_ack) {
+        vTaskDelay(1);
+    }
+    mcpwm_timer_sync_phase_config_t phase_config = { .sync_src = NULL }; // stop following breakdown
+    ESP_RETURN_ON_ERROR(mcpwm_timer_set_phase_on_sync(timer, &phase_config), TAG, "remove sync failed");
+    return mcpwm_timer_set_period(timer, period_ticks);
 }
 
 void mcpwm_halfbridge_task(void *pvParameters)
@@ -65,9 +227,10 @@ void mcpwm_halfbridge_task(void *pvParameters)
     mcpwm_timer_config_t timer_config = {
         .group_id = 0,
         .clk_src = MCPWM_TIMER_CLK_SRC_DEFAULT,
-        .resolution_hz = 10000000,
+        .resolution_hz = PWM_RESOLUTION_HZ,
         .count_mode = MCPWM_TIMER_COUNT_MODE_UP,
-        .period_ticks = 10000000 / PWM_FREQ_HZ,
+        .period_ticks = PWM_RESOLUTION_HZ / PWM_FREQ_HZ,
+        .flags.update_period_on_empty = true, // isopulse period changes latch with the compare value
     };
     ESP_ERROR_CHECK(mcpwm_new_timer(&timer_config, &timer));
 
@@ -81,7 +244,8 @@ void mcpwm_halfbridge_task(void *pvParameters)
     ESP_ERROR_CHECK(mcpwm_new_comparator(oper, &comparator_config, &comparator));
 
     mcpwm_gen_handle_t gen_a = NULL, gen_b = NULL;
-    mcpwm_generator_config_t gen_config_a = { .gen_gpio_num = MCPWM_GPIO_PWM0A };
+    // Loop back PWM0A so the overcurrent latency probe can capture its falling edge
+    mcpwm_generator_config_t gen_config_a = { .gen_gpio_num = MCPWM_GPIO_PWM0A, .flags.io_loop_back = true };
     mcpwm_generator_config_t gen_config_b = { .gen_gpio_num = MCPWM_GPIO_PWM0B };
     ESP_ERROR_CHECK(mcpwm_new_generator(oper, &gen_config_a, &gen_a));
     ESP_ERROR_CHECK(mcpwm_new_generator(oper, &gen_config_b, &gen_b));
@@ -103,42 +267,93 @@ void mcpwm_halfbridge_task(void *pvParameters)
     ESP_ERROR_CHECK(mcpwm_generator_set_action_on_compare_event(
         gen_b, MCPWM_GEN_COMPARE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, comparator, MCPWM_GEN_ACTION_HIGH)));
 
+    // Hardware overcurrent trip, armed before the timer starts so the first cycle is already protected
+    overcurrent_trip_config_t trip_config = {
+        .fault_gpio_num = MCPWM_FAULT_GPIO,
+        .fault_active_high = true,
+        .mode = MCPWM_TRIP_MODE,
+    };
+    ESP_ERROR_CHECK(overcurrent_trip_init(&trip_config, oper, gen_a, gen_b));
+
+    // Current loop, soft starts from zero duty once the timer runs
+    current_regulator_config_t regulator_config = {
+        .kp_q16 = 20,
+        .ki_q16 = 100,                          // ~0.5 loop gain at 300 mA/tick, see host_test/test_current_regulator.py
+        .slew_ticks_q16 = 5 << 16,              // 1% duty per update
+        .soft_start_ticks_q16 = 6554,           // 0.1 tick per update, 0 -> 40% duty in 0.4 s
+    };
+    current_regulator_init(&current_regulator, &regulator_config);
+    current_loop_period_ticks = timer_config.period_ticks;
+    ESP_ERROR_CHECK(mcpwm_timer_register_event_callbacks(timer, &(mcpwm_timer_event_callbacks_t){
+        .on_empty = current_loop_on_empty,
+    }, comparator));
+    current_loop_ack = true; // until the first TEZ callback has run, assume it may be updating
+    current_loop_active = true;
+
     ESP_ERROR_CHECK(mcpwm_timer_enable(timer));
     ESP_ERROR_CHECK(mcpwm_timer_start_stop(timer, MCPWM_TIMER_START_NO_STOP));
 
-    // Create semaphore for capture event
-    capture_semaphore = xSemaphoreCreateBinary();
+    // Create semaphore for capture event, unless sim_io.c already did
+    if (!capture_semaphore) {
+        capture_semaphore = xSemaphoreCreateBinary();
+    }
     // Setup capture for external signal
-    setup_mcpwm_capture(timer);
+    mcpwm_cap_timer_handle_t cap_timer = setup_mcpwm_capture(timer);
+    ESP_ERROR_CHECK(overcurrent_trip_attach_latency_probe(cap_timer, MCPWM_GPIO_PWM0A));
+    mcpwm_sync_handle_t breakdown_sync = setup_breakdown_sync();
 
     uint32_t period_ticks = timer_config.period_ticks;
 
-    // Soft start: ramp duty from 0 to 40%
-    for (int soft_duty = 0; soft_duty <= 40; soft_duty++) {
-        uint32_t duty_ticks = period_ticks * soft_duty / 100;
-        ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, duty_ticks));
-        vTaskDelay(pdMS_TO_TICKS(20)); // Adjust delay for ramp speed
-    }
-    duty_percent = 40; // Ensure main loop starts at 40%
-
+    bool isopulse_active = false;
+    isopulse_timing_t isopulse_applied = {0};
     while (1) {
-        // Clamp duty_percent to [0, 100]
-        int local_duty = duty_percent;
-        if (local_duty < 0) local_duty = 0;
-        if (local_duty > 100) local_duty = 100;
-
-        uint32_t duty_ticks = period_ticks * local_duty / 100;
-        ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, duty_ticks));
-
-        // Small delay to allow current to propagate after high side turns on
-        esp_rom_delay_us(2); // Adjust as needed for your hardware
+        if (isopulse_enabled) {
+            // Publishers validated the timing, it is applied as is
+            isopulse_params_t params;
+            isopulse_timing_t timing;
+            mcpwm_isopulse_get(&params, &timing);
+            if (!isopulse_active || memcmp(&timing, &isopulse_applied, sizeof(timing)) != 0) {
+                // Take the comparator over only once a TEZ callback has seen the loop stopped
+                current_loop_active = false;
+                while (current_loop_ack) {
+                    vTaskDelay(1);
+                }
+                ESP_ERROR_CHECK(apply_isopulse(timer, comparator, breakdown_sync, &timing));
+                ESP_LOGI(TAG, "Isopulse: on=%" PRIu32 "ns off=%" PRIu32 "ns max ignition=%" PRIu32 "ns",
+                         params.on_time_ns, params.off_time_ns, params.max_ignition_delay_ns);
+                isopulse_active = true;
+                isopulse_applied = timing;
+            }
+        } else {
+            if (isopulse_active) {
+                // Back to the fixed period, the current loop soft starts again from zero duty
+                ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, 0));
+                ESP_ERROR_CHECK(apply_isofrequency(timer, period_ticks));
+                current_loop_restart = true;
+                current_loop_ack = true;
+                current_loop_active = true;
+                isopulse_active = false;
+            }
+            // duty_percent and target_peak_current_ma are picked up by the TEZ callback
+        }
 
         // Trigger ADC task via semaphore (like before)
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
         if (capture_semaphore) {
             xSemaphoreGive(capture_semaphore);
         }
 
+        overcurrent_trip_stats_t trip_stats;
+        bool tripped = overcurrent_trip_poll(&trip_stats);
+        if (tripped || trip_stats.latched) {
+            current_loop_restart = true; // soft start once the outputs are back
+        }
+        if (tripped) {
+            ESP_LOGW(TAG, "Overcurrent trip: trips=%" PRIu32 " cbc_cycles=%" PRIu32 " ost=%" PRIu32 "%s already_off=%" PRIu32
+                     " latency last=%" PRIu32 "ns max=%" PRIu32 "ns",
+                     trip_stats.trips, trip_stats.cbc_cycles, trip_stats.ost_latches, trip_stats.latched ? " (latched)" : "",
+                     trip_stats.already_off, trip_stats.last_latency_ns, trip_stats.max_latency_ns);
+        }
+
         vTaskDelay(pdMS_TO_TICKS(20)); // Update rate
     }
 }
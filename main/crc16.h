@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), used by the flash recorder and the UART protocol
+ */
+uint16_t crc16_ccitt(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,60 @@
+#include "current_regulator.h"
+
+#define TICKS_Q16(ticks) ((int32_t)(ticks) << 16)
+
+static int32_t clamp(int32_t value, int32_t low, int32_t high)
+{
+    return value < low ? low : value > high ? high : value;
+}
+
+void current_regulator_init(current_regulator_t *reg, const current_regulator_config_t *config)
+{
+    reg->config = *config;
+    current_regulator_restart(reg);
+}
+
+void current_regulator_restart(current_regulator_t *reg)
+{
+    reg->compare_q16 = 0;
+    reg->ceiling_q16 = 0;
+    reg->last_error_ma = 0;
+}
+
+// Common tail: soft start ceiling, slew limit and output clamp
+static uint32_t apply(current_regulator_t *reg, int32_t delta_q16, uint32_t max_compare_ticks)
+{
+    int32_t max_q16 = TICKS_Q16(max_compare_ticks);
+    if (reg->ceiling_q16 < max_q16) {
+        reg->ceiling_q16 += clamp((int32_t)reg->config.soft_start_ticks_q16, 0, max_q16 - reg->ceiling_q16);
+    } else {
+        reg->ceiling_q16 = max_q16; // a lower duty limit takes effect at once
+    }
+    int32_t slew = (int32_t)reg->config.slew_ticks_q16;
+    reg->compare_q16 = clamp(reg->compare_q16 + clamp(delta_q16, -slew, slew), 0, reg->ceiling_q16);
+    return (uint32_t)(reg->compare_q16 + (1 << 15)) >> 16;
+}
+
+static int32_t pi_delta(current_regulator_t *reg, uint32_t target_ma, uint32_t measured_ma)
+{
+    int32_t error_ma = (int32_t)target_ma - (int32_t)measured_ma;
+    int64_t delta_q16 = (int64_t)reg->config.ki_q16 * error_ma + (int64_t)reg->config.kp_q16 * (error_ma - reg->last_error_ma);
+    reg->last_error_ma = error_ma;
+    return delta_q16 > INT32_MAX ? INT32_MAX : delta_q16 < -INT32_MAX ? -INT32_MAX : (int32_t)delta_q16;
+}
+
+uint32_t current_regulator_update(current_regulator_t *reg, uint32_t target_ma, uint32_t measured_ma, uint32_t max_compare_ticks)
+{
+    return apply(reg, pi_delta(reg, target_ma, measured_ma), max_compare_ticks);
+}
+
+uint32_t current_regulator_update_braked(current_regulator_t *reg, uint32_t target_ma, uint32_t measured_ma, uint32_t max_compare_ticks)
+{
+    int32_t delta_q16 = pi_delta(reg, target_ma, measured_ma);
+    return apply(reg, delta_q16 < 0 ? delta_q16 : 0, max_compare_ticks);
+}
+
+uint32_t current_regulator_update_open_loop(current_regulator_t *reg, uint32_t compare_ticks)
+{
+    reg->last_error_ma = 0;
+    return apply(reg, TICKS_Q16(compare_ticks) - reg->compare_q16, compare_ticks);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Peak current regulator configuration
+ *
+ * Gains are in Q16 compare ticks per mA of error. The loop is an incremental PI: every update
+ * moves the compare value by ki * error + kp * (error - previous error), limited to
+ * slew_ticks_q16, so it has no integrator to wind up beyond the output clamp.
+ *
+ * The output is then clamped to a ceiling that follows the duty limit. A lower limit applies at
+ * once and can cut the output by more than slew_ticks_q16. A higher limit is approached at
+ * soft_start_ticks_q16 per update.
+ */
+typedef struct {
+    int32_t kp_q16;                  // Proportional gain
+    int32_t ki_q16;                  // Integral gain, per update
+    uint32_t slew_ticks_q16;         // Largest PI step per update, below the ceiling
+    uint32_t soft_start_ticks_q16;   // Ceiling rise per update after a restart
+} current_regulator_config_t;
+
+/**
+ * @brief Regulator state, integer only so it can run in an ISR
+ */
+typedef struct {
+    current_regulator_config_t config;
+    int32_t compare_q16;  // Output, Q16 ticks
+    int32_t ceiling_q16;  // Soft start ceiling, Q16 ticks
+    int32_t last_error_ma;
+} current_regulator_t;
+
+/**
+ * @brief Set up the regulator, starting with a soft start from zero
+ */
+void current_regulator_init(current_regulator_t *reg, const current_regulator_config_t *config);
+
+/**
+ * @brief Soft start again from zero output, e.g. after an overcurrent trip
+ */
+void current_regulator_restart(current_regulator_t *reg);
+
+/**
+ * @brief Closed loop update towards a target peak current
+ *
+ * @param[in] target_ma Wanted peak current
+ * @param[in] measured_ma Peak current of the last pulse
+ * @param[in] max_compare_ticks Duty ceiling, the output never exceeds it
+ * @return New compare value in ticks
+ */
+uint32_t current_regulator_update(current_regulator_t *reg, uint32_t target_ma, uint32_t measured_ma, uint32_t max_compare_ticks);
+
+/**
+ * @brief Closed loop update when the cycle-by-cycle brake cut pulses since the last update
+ *
+ * The measured peak is then the trip level, not the result of the compare value. The integrator
+ * is frozen against raising the output, so a target above the trip level cannot wind it up to
+ * the ceiling. It still comes down when the target is below the measured peak.
+ *
+ * @param[in] target_ma Wanted peak current
+ * @param[in] measured_ma Peak current of the last pulse
+ * @param[in] max_compare_ticks Duty ceiling, the output never exceeds it
+ * @return New compare value in ticks
+ */
+uint32_t current_regulator_update_braked(current_regulator_t *reg, uint32_t target_ma, uint32_t measured_ma, uint32_t max_compare_ticks);
+
+/**
+ * @brief Open loop update towards a fixed compare value
+ *
+ * The value is also the duty limit: less duty applies at once, more duty ramps at the soft start rate.
+ *
+ * @return New compare value in ticks
+ */
+uint32_t current_regulator_update_open_loop(current_regulator_t *reg, uint32_t compare_ticks);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,299 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cut_program.h"
+#include "stepper_curve.h"
+
+#define RATE_SAMPLE_MS 1000 // Removal rate is sampled once per second
+#define RATE_FILTER_DIV 4   // and filtered with a 1/4 weight per sample
+
+static void set_err(char *err, size_t err_len, const char *fmt, int num, const char *detail)
+{
+    if (err && err_len) {
+        snprintf(err, err_len, fmt, num, detail);
+    }
+}
+
+static bool parse_double(const char *value, double *out)
+{
+    char *end = NULL;
+    double v = strtod(value, &end);
+    if (end == value || *end != '\0' || !isfinite(v)) { // strtod() accepts "nan" and "inf"
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_int(const char *value, long min, long max, long *out)
+{
+    char *end = NULL;
+    long v = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || v < min || v > max) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// Apply one key=value token to a stage, false if the key is unknown or the value malformed
+static bool parse_setting(cut_stage_t *stage, const char *key, const char *value, bool *has_depth)
+{
+    long v = 0;
+    if (strcmp(key, "depth") == 0) {
+        *has_depth = true;
+        return parse_double(value, &stage->target_depth_mm);
+    } else if (strcmp(key, "feed") == 0) {
+        return parse_double(value, &stage->feed_speed_mm_per_s);
+    } else if (strcmp(key, "duty") == 0) {
+        bool ok = parse_int(value, 0, 100, &v);
+        stage->duty_percent = (int)v;
+        return ok;
+    } else if (strcmp(key, "on_ns") == 0) {
+        bool ok = parse_int(value, 0, INT32_MAX, &v);
+        stage->on_time_ns = (uint32_t)v;
+        return ok;
+    } else if (strcmp(key, "off_ns") == 0) {
+        bool ok = parse_int(value, 0, INT32_MAX, &v);
+        stage->off_time_ns = (uint32_t)v;
+        return ok;
+    } else if (strcmp(key, "ignition_ns") == 0) {
+        bool ok = parse_int(value, 0, INT32_MAX, &v);
+        stage->max_ignition_ns = (uint32_t)v;
+        return ok;
+    } else if (strcmp(key, "gap_low") == 0) {
+        bool ok = parse_int(value, 0, 4095, &v);
+        stage->gap_low = (int)v;
+        return ok;
+    } else if (strcmp(key, "gap_high") == 0) {
+        bool ok = parse_int(value, 0, 4095, &v);
+        stage->gap_high = (int)v;
+        return ok;
+    } else if (strcmp(key, "lift_period_ms") == 0) {
+        bool ok = parse_int(value, 0, INT32_MAX, &v);
+        stage->lift_period_ms = (uint32_t)v;
+        return ok;
+    } else if (strcmp(key, "lift_min_ms") == 0) {
+        bool ok = parse_int(value, 0, INT32_MAX, &v);
+        stage->lift_min_period_ms = (uint32_t)v;
+        return ok;
+    }
+    return false;
+}
+
+bool cut_program_parse(const char *text, const cut_stage_t *defaults, cut_program_t *out_program, char *err, size_t err_len)
+{
+    if (!text || !defaults || !out_program) {
+        set_err(err, err_len, "line %d: %s", 0, "invalid arguments");
+        return false;
+    }
+    memset(out_program, 0, sizeof(*out_program));
+    cut_stage_t current = *defaults;
+    int line_num = 0;
+    const char *line = text;
+    while (*line) {
+        line_num++;
+        const char *line_end = strchr(line, '\n');
+        size_t len = line_end ? (size_t)(line_end - line) : strlen(line);
+        char buf[160];
+        if (len >= sizeof(buf)) {
+            set_err(err, err_len, "line %d: %s", line_num, "line too long");
+            return false;
+        }
+        memcpy(buf, line, len);
+        buf[len] = '\0';
+        line = line_end ? line_end + 1 : line + len;
+
+        char *comment = strchr(buf, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        // Split into whitespace separated tokens in place
+        char *tokens[16];
+        int num_tokens = 0;
+        for (char *p = buf; *p;) {
+            while (*p && isspace((unsigned char)*p)) {
+                *p++ = '\0';
+            }
+            if (!*p) {
+                break;
+            }
+            if (num_tokens == 16) {
+                set_err(err, err_len, "line %d: %s", line_num, "too many settings");
+                return false;
+            }
+            tokens[num_tokens++] = p;
+            while (*p && !isspace((unsigned char)*p)) {
+                p++;
+            }
+        }
+        if (num_tokens == 0) {
+            continue;
+        }
+        if (strcmp(tokens[0], "stage") != 0) {
+            set_err(err, err_len, "line %d: unknown directive '%s'", line_num, tokens[0]);
+            return false;
+        }
+        if (out_program->num_stages == CUT_PROGRAM_MAX_STAGES) {
+            set_err(err, err_len, "line %d: %s", line_num, "too many stages");
+            return false;
+        }
+        bool has_depth = false;
+        for (int i = 1; i < num_tokens; i++) {
+            char *eq = strchr(tokens[i], '=');
+            if (!eq) {
+                set_err(err, err_len, "line %d: expected key=value, got '%s'", line_num, tokens[i]);
+                return false;
+            }
+            *eq = '\0';
+            if (!parse_setting(&current, tokens[i], eq + 1, &has_depth)) {
+                set_err(err, err_len, "line %d: bad setting '%s'", line_num, tokens[i]);
+                return false;
+            }
+        }
+        if (!has_depth) {
+            set_err(err, err_len, "line %d: %s", line_num, "stage needs a depth");
+            return false;
+        }
+        out_program->stages[out_program->num_stages++] = current;
+    }
+    if (out_program->num_stages == 0) {
+        set_err(err, err_len, "line %d: %s", line_num, "program has no stages");
+        return false;
+    }
+    return true;
+}
+
+bool cut_program_prepare(cut_program_t *program, double steps_per_mm, uint32_t step_resolution_hz, uint32_t pwm_resolution_hz,
+                         char *err, size_t err_len)
+{
+    if (!program || program->num_stages == 0 || program->num_stages > CUT_PROGRAM_MAX_STAGES || !(steps_per_mm > 0)) {
+        set_err(err, err_len, "stage %d: %s", 0, "invalid program");
+        return false;
+    }
+    // Range checks are written so that NaN fails them
+    int32_t previous_steps = 0;
+    for (size_t i = 0; i < program->num_stages; i++) {
+        cut_stage_t *stage = &program->stages[i];
+        int num = (int)i + 1;
+        double target_steps = stage->target_depth_mm * steps_per_mm;
+        if (!(target_steps >= 1 && target_steps <= INT32_MAX)) {
+            set_err(err, err_len, "stage %d: %s", num, "depth out of range");
+            return false;
+        }
+        stage->target_steps = (int32_t)(target_steps + 0.5);
+        if (stage->target_steps <= previous_steps) {
+            set_err(err, err_len, "stage %d: %s", num, "depth must increase by at least one step");
+            return false;
+        }
+        previous_steps = stage->target_steps;
+
+        double feed_hz = stage->feed_speed_mm_per_s * steps_per_mm;
+        if (!(feed_hz + 0.5 >= stepper_uniform_min_freq_hz(step_resolution_hz) && feed_hz <= 100000)) {
+            set_err(err, err_len, "stage %d: %s", num, "feed out of range");
+            return false;
+        }
+        stage->feed_freq_hz = (uint32_t)(feed_hz + 0.5);
+
+        if (stage->duty_percent < 0 || stage->duty_percent > 100) {
+            set_err(err, err_len, "stage %d: %s", num, "duty out of range");
+            return false;
+        }
+        if (stage->on_time_ns) {
+            isopulse_params_t params = {
+                .on_time_ns = stage->on_time_ns,
+                .off_time_ns = stage->off_time_ns,
+                .max_ignition_delay_ns = stage->max_ignition_ns,
+            };
+            if (!isopulse_compute_timing(&params, pwm_resolution_hz, &stage->isopulse)) {
+                set_err(err, err_len, "stage %d: %s", num, "isopulse timing does not fit the PWM timer");
+                return false;
+            }
+        } else {
+            memset(&stage->isopulse, 0, sizeof(stage->isopulse));
+        }
+        if (stage->gap_low >= stage->gap_high) {
+            set_err(err, err_len, "stage %d: %s", num, "gap_low must be below gap_high");
+            return false;
+        }
+        if (stage->lift_period_ms && stage->lift_min_period_ms > stage->lift_period_ms) {
+            set_err(err, err_len, "stage %d: %s", num, "lift_min_ms above lift_period_ms");
+            return false;
+        }
+    }
+    return true;
+}
+
+void cut_program_start(cut_program_exec_t *exec, const cut_program_t *program, uint32_t now_ms)
+{
+    memset(exec, 0, sizeof(*exec));
+    exec->program = program;
+    exec->last_sample_ms = now_ms;
+}
+
+void cut_program_resume(cut_program_exec_t *exec, int32_t depth_steps, uint32_t now_ms)
+{
+    exec->last_sample_ms = now_ms;
+    exec->last_sample_steps = depth_steps;
+}
+
+bool cut_program_update(cut_program_exec_t *exec, int32_t depth_steps, uint32_t now_ms)
+{
+    if (exec->done) {
+        return false;
+    }
+    uint32_t elapsed_ms = now_ms - exec->last_sample_ms;
+    if (elapsed_ms >= RATE_SAMPLE_MS) {
+        double rate = (double)(depth_steps - exec->last_sample_steps) * 1000.0 / elapsed_ms;
+        if (rate < 0) {
+            rate = 0; // lifts and retracts are not negative removal
+        }
+        if (exec->rate_steps_per_s == 0) {
+            exec->rate_steps_per_s = rate;
+        } else {
+            exec->rate_steps_per_s += (rate - exec->rate_steps_per_s) / RATE_FILTER_DIV;
+        }
+        exec->last_sample_ms = now_ms;
+        exec->last_sample_steps = depth_steps;
+    }
+
+    bool changed = false;
+    const cut_program_t *program = exec->program;
+    while (exec->stage < program->num_stages && depth_steps >= program->stages[exec->stage].target_steps) {
+        exec->stage++;
+        changed = true;
+    }
+    if (exec->stage == program->num_stages) {
+        exec->done = true;
+    }
+    return changed;
+}
+
+const cut_stage_t *cut_program_current_stage(const cut_program_exec_t *exec)
+{
+    if (exec->done || !exec->program) {
+        return NULL;
+    }
+    return &exec->program->stages[exec->stage];
+}
+
+void cut_program_get_progress(const cut_program_exec_t *exec, int32_t depth_steps, double steps_per_mm, cut_program_progress_t *out_progress)
+{
+    const cut_program_t *program = exec->program;
+    int32_t final_steps = program->stages[program->num_stages - 1].target_steps;
+    memset(out_progress, 0, sizeof(*out_progress));
+    out_progress->stage = exec->stage;
+    out_progress->num_stages = program->num_stages;
+    out_progress->depth_mm = depth_steps / steps_per_mm;
+    out_progress->target_depth_mm = final_steps / steps_per_mm;
+    out_progress->percent = exec->done ? 100.0 : 100.0 * (depth_steps > 0 ? depth_steps : 0) / final_steps;
+    out_progress->rate_mm_per_min = exec->rate_steps_per_s * 60.0 / steps_per_mm;
+    if (exec->done) {
+        out_progress->eta_valid = true;
+    } else if (exec->rate_steps_per_s > 0) {
+        out_progress->eta_s = (uint32_t)((final_steps - depth_steps) / exec->rate_steps_per_s + 0.5);
+        out_progress->eta_valid = true;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "isopulse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUT_PROGRAM_MAX_STAGES 16
+
+/**
+ * @brief One stage of a cut program, run until the electrode reaches target_depth_mm
+ *
+ * Depths are absolute from the position where the cut started.
+ */
+typedef struct {
+    double target_depth_mm;      // Stage ends when the cut reaches this depth
+    double feed_speed_mm_per_s;  // Servo step rate while advancing or retracting
+    int duty_percent;            // Isofrequency duty, used when on_time_ns is 0
+    uint32_t on_time_ns;         // Isopulse discharge time, 0 selects isofrequency
+    uint32_t off_time_ns;        // Isopulse pause
+    uint32_t max_ignition_ns;    // Isopulse open-circuit wait
+    int gap_low;                 // Filtered gap ADC below this retracts
+    int gap_high;                // Filtered gap ADC above this advances
+    uint32_t lift_period_ms;     // Electrode lift interval, 0 disables lifting
+    uint32_t lift_min_period_ms; // Adaptive lift floor
+    // Filled in by cut_program_prepare()
+    int32_t target_steps;        // target_depth_mm in motor steps
+    uint32_t feed_freq_hz;       // feed_speed_mm_per_s as uniform encoder frequency
+    isopulse_timing_t isopulse;  // Timer values when on_time_ns is set
+} cut_stage_t;
+
+/**
+ * @brief Cut program, a list of stages with increasing target depth
+ */
+typedef struct {
+    cut_stage_t stages[CUT_PROGRAM_MAX_STAGES];
+    size_t num_stages;
+} cut_program_t;
+
+/**
+ * @brief Cut program executor state
+ */
+typedef struct {
+    const cut_program_t *program;
+    size_t stage;             // Index of the running stage
+    bool done;                // Last target depth reached
+    uint32_t last_sample_ms;  // Removal rate sampling
+    int32_t last_sample_steps;
+    double rate_steps_per_s;  // Filtered removal rate, 0 until the first sample
+} cut_program_exec_t;
+
+/**
+ * @brief Progress report
+ */
+typedef struct {
+    size_t stage;
+    size_t num_stages;
+    double depth_mm;
+    double target_depth_mm;       // Final depth of the program
+    double percent;
+    double rate_mm_per_min;
+    uint32_t eta_s;               // Valid when eta_valid is set
+    bool eta_valid;
+} cut_program_progress_t;
+
+/**
+ * @brief Parse a cut program from text
+ *
+ * One stage per line: `stage depth=<mm> [key=value ...]`. Keys are feed (mm/s), duty (%),
+ * on_ns, off_ns, ignition_ns, gap_low, gap_high, lift_period_ms and lift_min_ms. Keys that are
+ * left out keep the value of the previous stage, or the defaults for the first one.
+ * Blank lines and text after '#' are ignored.
+ *
+ * @param[in] text NUL terminated program text
+ * @param[in] defaults Settings used for keys the first stage leaves out
+ * @param[out] out_program Parsed stages
+ * @param[out] err Error message, can be NULL
+ * @param[in] err_len Size of err
+ * @return false on a syntax error, with the line number in err
+ */
+bool cut_program_parse(const char *text, const cut_stage_t *defaults, cut_program_t *out_program, char *err, size_t err_len);
+
+/**
+ * @brief Validate a program and precompute everything the cut loop needs
+ *
+ * Runs before the cut starts so that stage changes only copy precomputed values.
+ *
+ * @param[in,out] program Program to validate, target_steps, feed_freq_hz and isopulse are filled in
+ * @param[in] steps_per_mm Motor steps per mm of electrode travel
+ * @param[in] step_resolution_hz Stepper RMT resolution, sets the slowest feed the uniform encoder can build
+ * @param[in] pwm_resolution_hz MCPWM timer resolution, for the isopulse timing
+ * @param[out] err Error message, can be NULL
+ * @param[in] err_len Size of err
+ * @return false if any stage is out of range, with the stage number in err
+ */
+bool cut_program_prepare(cut_program_t *program, double steps_per_mm, uint32_t step_resolution_hz, uint32_t pwm_resolution_hz,
+                         char *err, size_t err_len);
+
+/**
+ * @brief Start executing a prepared program
+ */
+void cut_program_start(cut_program_exec_t *exec, const cut_program_t *program, uint32_t now_ms);
+
+/**
+ * @brief Continue a paused program at its current stage
+ *
+ * Restarts the removal rate sampling so the pause does not count as zero removal.
+ *
+ * @param[in] depth_steps Depth since the cut started, in motor steps
+ */
+void cut_program_resume(cut_program_exec_t *exec, int32_t depth_steps, uint32_t now_ms);
+
+/**
+ * @brief Advance the executor with the current depth
+ *
+ * @param[in] exec Executor
+ * @param[in] depth_steps Depth reached since the cut started, in motor steps
+ * @param[in] now_ms Current time
+ * @return true if the stage changed (or the program finished) on this call
+ */
+bool cut_program_update(cut_program_exec_t *exec, int32_t depth_steps, uint32_t now_ms);
+
+/**
+ * @brief Running stage, NULL once the program is done
+ */
+const cut_stage_t *cut_program_current_stage(const cut_program_exec_t *exec);
+
+/**
+ * @brief Progress and ETA from the measured removal rate
+ */
+void cut_program_get_progress(const cut_program_exec_t *exec, int32_t depth_steps, double steps_per_mm, cut_program_progress_t *out_progress);
+
+#ifdef __cplusplus
+}
+#endif
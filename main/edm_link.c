@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include "driver/uart.h"
+#include "driver/uart_vfs.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "edm_link.h"
+
+static const char *TAG = "edm_link";
+
+#define EDM_LINK_UART UART_NUM_0            // Shared with the console
+#define EDM_LINK_RX_BUF_SIZE 512
+#define EDM_LINK_TX_BUF_SIZE 1024           // Telemetry and responses are written without waiting on the wire
+#define EDM_LINK_POLL_MS 10                 // RX wait, also the telemetry batching granularity
+#define EDM_LINK_BATCH_RECORDS 8
+#define EDM_LINK_BATCH_MAX_AGE_MS 100
+#define EDM_LINK_QUEUE_LEN (2 * EDM_LINK_BATCH_RECORDS)
+#define EDM_LINK_TASK_STACK 3072
+#define EDM_LINK_TASK_PRIORITY 2            // Above the session recorder, below every control task
+
+_Static_assert(EDM_LINK_BATCH_RECORDS <= EDM_PROTO_TELEMETRY_MAX_RECORDS, "telemetry batch does not fit a frame");
+
+// Everything the link task touches is allocated here, the task loop never allocates
+static StaticTask_t link_task_tcb;
+static StackType_t link_task_stack[EDM_LINK_TASK_STACK];
+static StaticQueue_t telemetry_queue_storage;
+static uint8_t telemetry_queue_buf[EDM_LINK_QUEUE_LEN * sizeof(session_sample_t)];
+static QueueHandle_t telemetry_queue = NULL;
+
+// Only touched by the link task
+static edm_proto_parser_t parser;
+static edm_proto_frame_t request;
+static uint8_t rx_buf[64];
+static uint8_t tx_buf[EDM_PROTO_MAX_FRAME];
+static session_sample_t batch[EDM_LINK_BATCH_RECORDS];
+
+static const edm_proto_handlers_t *link_handlers = NULL;
+static volatile bool host_connected = false; // Set by the first valid frame
+static volatile uint32_t telemetry_hz = 10;
+
+// Producer side, touched by the cut loop only
+static uint32_t last_telemetry_ms = 0;
+static bool telemetry_any = false;
+
+static void link_write(size_t len)
+{
+    if (len) {
+        uart_write_bytes(EDM_LINK_UART, tx_buf, len); // one call per frame, atomic against console output
+    }
+}
+
+static void edm_link_task(void *pvParameters)
+{
+    uint8_t telemetry_seq = 0;
+    size_t batch_count = 0;
+    TickType_t batch_start = 0;
+    while (1) {
+        int n = uart_read_bytes(EDM_LINK_UART, rx_buf, sizeof(rx_buf), pdMS_TO_TICKS(EDM_LINK_POLL_MS));
+        for (int i = 0; i < n; i++) {
+            if (!edm_proto_feed(&parser, rx_buf[i], &request)) {
+                continue;
+            }
+            if (!host_connected) {
+                ESP_LOGW(TAG, "Host connected, log level lowered to WARN");
+                esp_log_level_set("*", ESP_LOG_WARN);
+                host_connected = true;
+            }
+            link_write(edm_proto_handle(&request, link_handlers, tx_buf, sizeof(tx_buf)));
+        }
+
+        while (batch_count < EDM_LINK_BATCH_RECORDS && xQueueReceive(telemetry_queue, &batch[batch_count], 0) == pdTRUE) {
+            if (batch_count++ == 0) {
+                batch_start = xTaskGetTickCount();
+            }
+        }
+        if (batch_count == EDM_LINK_BATCH_RECORDS ||
+                (batch_count && xTaskGetTickCount() - batch_start >= pdMS_TO_TICKS(EDM_LINK_BATCH_MAX_AGE_MS))) {
+            link_write(edm_proto_encode_telemetry(batch, batch_count, telemetry_seq++, tx_buf, sizeof(tx_buf)));
+            batch_count = 0;
+        }
+    }
+}
+
+esp_err_t edm_link_init(const edm_proto_handlers_t *handlers)
+{
+    link_handlers = handlers;
+    if (!uart_is_driver_installed(EDM_LINK_UART)) {
+        ESP_RETURN_ON_ERROR(uart_driver_install(EDM_LINK_UART, EDM_LINK_RX_BUF_SIZE, EDM_LINK_TX_BUF_SIZE, 0, NULL, 0),
+                            TAG, "uart driver install failed");
+    }
+    // Route the console through the driver so log lines and frames never interleave mid-write
+    uart_vfs_dev_use_driver(EDM_LINK_UART);
+    telemetry_queue = xQueueCreateStatic(EDM_LINK_QUEUE_LEN, sizeof(session_sample_t), telemetry_queue_buf, &telemetry_queue_storage);
+    xTaskCreateStatic(edm_link_task, "edm_link", EDM_LINK_TASK_STACK, NULL, EDM_LINK_TASK_PRIORITY, link_task_stack, &link_task_tcb);
+    ESP_LOGI(TAG, "Host link on UART%d at %d baud", EDM_LINK_UART, CONFIG_ESP_CONSOLE_UART_BAUDRATE);
+    return ESP_OK;
+}
+
+void edm_link_telemetry(const session_sample_t *sample)
+{
+    uint32_t hz = telemetry_hz;
+    if (!host_connected || !hz || !telemetry_queue) {
+        return;
+    }
+    if (telemetry_any && sample->time_ms - last_telemetry_ms < 1000 / hz) {
+        return;
+    }
+    telemetry_any = true;
+    last_telemetry_ms = sample->time_ms;
+    xQueueSend(telemetry_queue, sample, 0); // a full queue means the host cannot keep up, drop
+}
+
+esp_err_t edm_link_set_telemetry_hz(uint32_t hz)
+{
+    ESP_RETURN_ON_FALSE(hz <= EDM_LINK_MAX_TELEMETRY_HZ, ESP_ERR_INVALID_ARG, TAG, "telemetry rate too high");
+    telemetry_hz = hz;
+    return ESP_OK;
+}
+
+uint32_t edm_link_get_telemetry_hz(void)
+{
+    return telemetry_hz;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "edm_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EDM_LINK_MAX_TELEMETRY_HZ 50 // One record per servo iteration at most
+
+/**
+ * @brief Take over the console UART for the host protocol and start the link task
+ *
+ * Console output keeps working through the UART driver. Once the first valid frame arrives the
+ * log level drops to WARN so the servo debug output does not crowd out telemetry.
+ *
+ * @param[in] handlers Parameter and command callbacks, called from the link task, must stay valid
+ * @return
+ *      - Error from uart_driver_install() if the UART driver cannot be installed
+ *      - ESP_OK on success
+ */
+esp_err_t edm_link_init(const edm_proto_handlers_t *handlers);
+
+/**
+ * @brief Offer a servo sample for telemetry, decimated to the configured rate
+ *
+ * Never blocks and does nothing until a host has connected. Samples are sent in batches of
+ * up to 8 records, at the latest 100 ms after the first one in the batch.
+ */
+void edm_link_telemetry(const session_sample_t *sample);
+
+/**
+ * @brief Set the telemetry rate, 0 stops telemetry
+ *
+ * @return ESP_ERR_INVALID_ARG above EDM_LINK_MAX_TELEMETRY_HZ
+ */
+esp_err_t edm_link_set_telemetry_hz(uint32_t hz);
+
+/**
+ * @brief Current telemetry rate
+ */
+uint32_t edm_link_get_telemetry_hz(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "crc16.h"
+#include "edm_protocol.h"
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v & 0xFFFF);
+    put_u16(p + 2, v >> 16);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t edm_proto_encode(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out, size_t out_size)
+{
+    if (len > EDM_PROTO_MAX_PAYLOAD || out_size < EDM_PROTO_HEADER_SIZE + len + 2) {
+        return 0;
+    }
+    out[0] = EDM_PROTO_SOF;
+    out[1] = type;
+    out[2] = seq;
+    put_u16(&out[3], len);
+    if (len) {
+        memcpy(&out[EDM_PROTO_HEADER_SIZE], payload, len);
+    }
+    put_u16(&out[EDM_PROTO_HEADER_SIZE + len], crc16_ccitt(&out[1], EDM_PROTO_HEADER_SIZE - 1 + len));
+    return EDM_PROTO_HEADER_SIZE + len + 2;
+}
+
+// Drop the first byte and rescan the buffered bytes for the next SOF
+static void parser_resync(edm_proto_parser_t *parser)
+{
+    uint16_t next = 1;
+    while (next < parser->pos && parser->buf[next] != EDM_PROTO_SOF) {
+        next++;
+    }
+    memmove(parser->buf, &parser->buf[next], parser->pos - next);
+    parser->pos -= next;
+}
+
+bool edm_proto_feed(edm_proto_parser_t *parser, uint8_t byte, edm_proto_frame_t *out_frame)
+{
+    if (parser->pos == 0 && byte != EDM_PROTO_SOF) {
+        return false;
+    }
+    parser->buf[parser->pos++] = byte;
+    while (parser->pos >= EDM_PROTO_HEADER_SIZE) {
+        uint16_t len = parser->buf[3] | (parser->buf[4] << 8);
+        if (len > EDM_PROTO_MAX_PAYLOAD) {
+            parser_resync(parser);
+            continue;
+        }
+        uint16_t frame_len = EDM_PROTO_HEADER_SIZE + len + 2;
+        if (parser->pos < frame_len) {
+            return false;
+        }
+        uint16_t crc = parser->buf[frame_len - 2] | (parser->buf[frame_len - 1] << 8);
+        if (crc != crc16_ccitt(&parser->buf[1], EDM_PROTO_HEADER_SIZE - 1 + len)) {
+            parser->crc_errors++;
+            parser_resync(parser);
+            continue;
+        }
+        out_frame->type = parser->buf[1];
+        out_frame->seq = parser->buf[2];
+        out_frame->len = len;
+        memcpy(out_frame->payload, &parser->buf[EDM_PROTO_HEADER_SIZE], len);
+        parser->pos = 0; // a frame is only complete on its last byte, nothing is left over
+        return true;
+    }
+    return false;
+}
+
+static size_t encode_nack(const edm_proto_frame_t *request, uint8_t reason, uint8_t *out, size_t out_size)
+{
+    uint8_t payload[2] = { request->type, reason };
+    return edm_proto_encode(EDM_PROTO_MSG_NACK, request->seq, payload, sizeof(payload), out, out_size);
+}
+
+static size_t encode_param(const edm_proto_frame_t *request, uint8_t id, int32_t value, uint8_t *out, size_t out_size)
+{
+    uint8_t payload[5] = { id };
+    put_u32(&payload[1], (uint32_t)value);
+    return edm_proto_encode(EDM_PROTO_MSG_PARAM, request->seq, payload, sizeof(payload), out, out_size);
+}
+
+size_t edm_proto_handle(const edm_proto_frame_t *request, const edm_proto_handlers_t *handlers, uint8_t *out, size_t out_size)
+{
+    int32_t value = 0;
+    uint8_t reason = 0;
+    switch (request->type) {
+    case EDM_PROTO_MSG_PING:
+        return edm_proto_encode(EDM_PROTO_MSG_PONG, request->seq, request->payload, request->len, out, out_size);
+    case EDM_PROTO_MSG_GET_PARAM:
+        if (request->len != 1) {
+            return encode_nack(request, EDM_PROTO_NACK_BAD_LENGTH, out, out_size);
+        }
+        if (!handlers->get_param(request->payload[0], &value, handlers->ctx)) {
+            return encode_nack(request, EDM_PROTO_NACK_UNKNOWN_PARAM, out, out_size);
+        }
+        return encode_param(request, request->payload[0], value, out, out_size);
+    case EDM_PROTO_MSG_SET_PARAM:
+        if (request->len != 5) {
+            return encode_nack(request, EDM_PROTO_NACK_BAD_LENGTH, out, out_size);
+        }
+        reason = handlers->set_param(request->payload[0], (int32_t)get_u32(&request->payload[1]), handlers->ctx);
+        if (reason) {
+            return encode_nack(request, reason, out, out_size);
+        }
+        // Read back so the host sees what was applied
+        handlers->get_param(request->payload[0], &value, handlers->ctx);
+        return encode_param(request, request->payload[0], value, out, out_size);
+    case EDM_PROTO_MSG_COMMAND:
+        if (request->len != 5) {
+            return encode_nack(request, EDM_PROTO_NACK_BAD_LENGTH, out, out_size);
+        }
+        reason = handlers->command(request->payload[0], (int32_t)get_u32(&request->payload[1]), handlers->ctx);
+        if (reason) {
+            return encode_nack(request, reason, out, out_size);
+        }
+        return edm_proto_encode(EDM_PROTO_MSG_ACK, request->seq, &request->type, 1, out, out_size);
+    default:
+        return encode_nack(request, EDM_PROTO_NACK_UNKNOWN_TYPE, out, out_size);
+    }
+}
+
+size_t edm_proto_encode_telemetry(const session_sample_t *samples, size_t count, uint8_t seq, uint8_t *out, size_t out_size)
+{
+    uint8_t payload[1 + EDM_PROTO_TELEMETRY_MAX_RECORDS * EDM_PROTO_TELEMETRY_RECORD_SIZE];
+    if (count > EDM_PROTO_TELEMETRY_MAX_RECORDS) {
+        return 0;
+    }
+    payload[0] = count;
+    uint8_t *p = &payload[1];
+    for (size_t i = 0; i < count; i++, p += EDM_PROTO_TELEMETRY_RECORD_SIZE) {
+        put_u32(&p[0], samples[i].time_ms);
+        put_u32(&p[4], (uint32_t)samples[i].position_steps);
+        put_u16(&p[8], samples[i].gap_adc);
+        p[10] = (uint8_t)samples[i].servo;
+        p[11] = samples[i].pulse_class;
+    }
+    return edm_proto_encode(EDM_PROTO_MSG_TELEMETRY, seq, payload, 1 + count * EDM_PROTO_TELEMETRY_RECORD_SIZE, out, out_size);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "session_block.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame layout, little endian:
+ *   0      u8  EDM_PROTO_SOF
+ *   1      u8  type           EDM_PROTO_MSG_*
+ *   2      u8  seq            responses echo the request seq
+ *   3      u16 payload length (<= EDM_PROTO_MAX_PAYLOAD)
+ *   5      payload
+ *   5+len  u16 CRC-16/CCITT-FALSE over type, seq, length and payload
+ *
+ * The link shares UART0 with the console, the receiver skips anything that is not a valid frame.
+ * tools/edm_client.py is the host side and must be kept in step with these definitions.
+ */
+#define EDM_PROTO_SOF 0xA5
+#define EDM_PROTO_HEADER_SIZE 5
+#define EDM_PROTO_MAX_PAYLOAD 240
+#define EDM_PROTO_MAX_FRAME (EDM_PROTO_HEADER_SIZE + EDM_PROTO_MAX_PAYLOAD + 2)
+
+typedef enum {
+    EDM_PROTO_MSG_PING = 0x01,      // any payload, answered with PONG echoing it
+    EDM_PROTO_MSG_PONG = 0x02,
+    EDM_PROTO_MSG_GET_PARAM = 0x10, // u8 id
+    EDM_PROTO_MSG_PARAM = 0x11,     // u8 id, i32 value
+    EDM_PROTO_MSG_SET_PARAM = 0x12, // u8 id, i32 value, answered with PARAM holding the applied value
+    EDM_PROTO_MSG_COMMAND = 0x20,   // u8 command, i32 argument, answered with ACK
+    EDM_PROTO_MSG_TELEMETRY = 0x30, // u8 count, count * EDM_PROTO_TELEMETRY_RECORD_SIZE records
+    EDM_PROTO_MSG_ACK = 0x7E,       // u8 request type
+    EDM_PROTO_MSG_NACK = 0x7F,      // u8 request type, u8 edm_proto_nack_t
+} edm_proto_msg_t;
+
+typedef enum {
+    EDM_PROTO_NACK_UNKNOWN_TYPE = 1,
+    EDM_PROTO_NACK_BAD_LENGTH = 2,
+    EDM_PROTO_NACK_UNKNOWN_PARAM = 3,
+    EDM_PROTO_NACK_OUT_OF_RANGE = 4,
+    EDM_PROTO_NACK_UNKNOWN_COMMAND = 5,
+    EDM_PROTO_NACK_BUSY = 6,
+    EDM_PROTO_NACK_READ_ONLY = 7,
+} edm_proto_nack_t;
+
+/**
+ * @brief Parameters, all carried as i32 in the units below
+ */
+typedef enum {
+    EDM_PARAM_DUTY_PERCENT = 1,      // %
+    EDM_PARAM_CUT_SPEED_UM_S = 2,    // um/s, servo feed while cutting
+    EDM_PARAM_GAP_LOW = 3,           // ADC
+    EDM_PARAM_GAP_HIGH = 4,          // ADC
+    EDM_PARAM_ISOPULSE_ENABLE = 5,   // 0/1
+    EDM_PARAM_ISOPULSE_ON_NS = 6,    // ns
+    EDM_PARAM_ISOPULSE_OFF_NS = 7,   // ns
+    EDM_PARAM_ISOPULSE_IGNITION_NS = 8, // ns
+    EDM_PARAM_TELEMETRY_HZ = 9,      // telemetry records per second, 0 stops telemetry
+    EDM_PARAM_JOG_SPEED_UM_S = 10,   // um/s, button and remote jog, retuned while moving
+    EDM_PARAM_PEAK_CURRENT_MA = 11,  // mA, closed loop peak current target, 0 runs open loop at the duty
+    EDM_PARAM_TRIP_COUNT = 12,       // read only, overcurrent trips since boot
+    EDM_PARAM_TRIP_CBC_CYCLES = 13,  // read only, PWM cycles braked by cycle-by-cycle trips
+    EDM_PARAM_TRIP_OST_LATCHES = 14, // read only, one-shot latches taken
+    EDM_PARAM_TRIP_LATCHED = 15,     // read only, 0/1, a one-shot latch is holding the outputs off
+} edm_param_id_t;
+
+typedef enum {
+    EDM_CMD_START = 1, // start the cut program, as if START_CUT_GPIO was set
+    EDM_CMD_STOP = 2,  // stop cutting
+    EDM_CMD_JOG = 3,   // argument: steps, positive towards the workpiece
+    EDM_CMD_CLEAR_TRIP = 4, // release a one-shot overcurrent latch, busy while the fault input is active
+} edm_command_t;
+
+// time_ms u32, position_steps i32, gap_adc u16, servo i8, pulse_class u8
+#define EDM_PROTO_TELEMETRY_RECORD_SIZE 12
+#define EDM_PROTO_TELEMETRY_MAX_RECORDS ((EDM_PROTO_MAX_PAYLOAD - 1) / EDM_PROTO_TELEMETRY_RECORD_SIZE)
+
+/**
+ * @brief Decoded frame
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint16_t len;
+    uint8_t payload[EDM_PROTO_MAX_PAYLOAD];
+} edm_proto_frame_t;
+
+/**
+ * @brief Byte stream parser, resynchronises on the next SOF after garbage or a CRC error
+ */
+typedef struct {
+    uint8_t buf[EDM_PROTO_MAX_FRAME];
+    uint16_t pos;
+    uint32_t crc_errors;
+} edm_proto_parser_t;
+
+/**
+ * @brief Application callbacks used by edm_proto_handle()
+ *
+ * get_param returns false for unknown ids. set_param and command return 0 on success or an
+ * edm_proto_nack_t reason.
+ */
+typedef struct {
+    bool (*get_param)(uint8_t id, int32_t *out_value, void *ctx);
+    uint8_t (*set_param)(uint8_t id, int32_t value, void *ctx);
+    uint8_t (*command)(uint8_t command, int32_t arg, void *ctx);
+    void *ctx;
+} edm_proto_handlers_t;
+
+/**
+ * @brief Encode a frame
+ *
+ * @return Frame length, 0 if the payload is too long or out is too small
+ */
+size_t edm_proto_encode(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out, size_t out_size);
+
+/**
+ * @brief Feed one received byte
+ *
+ * @return true when out_frame holds a complete frame with a good CRC
+ */
+bool edm_proto_feed(edm_proto_parser_t *parser, uint8_t byte, edm_proto_frame_t *out_frame);
+
+/**
+ * @brief Run a request frame against the handlers and encode the response
+ *
+ * @return Response frame length in out
+ */
+size_t edm_proto_handle(const edm_proto_frame_t *request, const edm_proto_handlers_t *handlers, uint8_t *out, size_t out_size);
+
+/**
+ * @brief Encode a batch of samples as one telemetry frame
+ *
+ * @return Frame length, 0 if count exceeds EDM_PROTO_TELEMETRY_MAX_RECORDS
+ */
+size_t edm_proto_encode_telemetry(const session_sample_t *samples, size_t count, uint8_t seq, uint8_t *out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+#include "electrode_lift.h"
+
+#define RATE_ONE_Q16 (1UL << 16)
+
+void electrode_lift_init(electrode_lift_t *lift, const electrode_lift_config_t *config, uint32_t now_ms)
+{
+    lift->config = *config;
+    electrode_lift_reset(lift, now_ms);
+}
+
+void electrode_lift_reset(electrode_lift_t *lift, uint32_t now_ms)
+{
+    lift->short_rate_q16 = 0;
+    lift->last_lift_ms = now_ms;
+    lift->lifts = 0;
+}
+
+void electrode_lift_note_gap(electrode_lift_t *lift, bool short_or_arc)
+{
+    // Exponential moving average, rate += (sample - rate) / 2^shift
+    uint32_t sample = short_or_arc ? RATE_ONE_Q16 : 0;
+    uint32_t shift = lift->config.rate_filter_shift;
+    if (sample > lift->short_rate_q16) {
+        lift->short_rate_q16 += (sample - lift->short_rate_q16) >> shift;
+    } else {
+        lift->short_rate_q16 -= (lift->short_rate_q16 - sample) >> shift;
+    }
+}
+
+uint32_t electrode_lift_period_ms(const electrode_lift_t *lift)
+{
+    const electrode_lift_config_t *config = &lift->config;
+    if (config->min_period_ms >= config->period_ms || config->short_rate_full_permille == 0) {
+        return config->period_ms;
+    }
+    uint32_t full_q16 = (uint32_t)((uint64_t)config->short_rate_full_permille * RATE_ONE_Q16 / 1000);
+    uint32_t rate_q16 = lift->short_rate_q16 < full_q16 ? lift->short_rate_q16 : full_q16;
+    uint32_t span = config->period_ms - config->min_period_ms;
+    return config->period_ms - (uint32_t)((uint64_t)span * rate_q16 / full_q16);
+}
+
+bool electrode_lift_due(const electrode_lift_t *lift, uint32_t now_ms)
+{
+    if (lift->config.period_ms == 0) {
+        return false;
+    }
+    return now_ms - lift->last_lift_ms >= electrode_lift_period_ms(lift);
+}
+
+void electrode_lift_done(electrode_lift_t *lift, uint32_t now_ms)
+{
+    lift->last_lift_ms = now_ms;
+    lift->lifts++;
+}
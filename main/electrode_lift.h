@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Electrode lift (pecking) scheduler configuration
+ */
+typedef struct {
+    uint32_t period_ms;                // Lift interval while the gap is clean, 0 disables lifting
+    uint32_t min_period_ms;            // Shortest interval the adaptive rule may reach
+    uint32_t short_rate_full_permille; // Short/arc rate at which the interval reaches min_period_ms
+    uint32_t rate_filter_shift;        // Each servo sample moves the short rate by 1/2^shift
+} electrode_lift_config_t;
+
+/**
+ * @brief Electrode lift scheduler state
+ */
+typedef struct {
+    electrode_lift_config_t config;
+    uint32_t short_rate_q16; // Filtered short/arc rate, Q16 fraction of servo samples
+    uint32_t last_lift_ms;   // Time the previous lift finished (or the cut started)
+    uint32_t lifts;          // Lifts done since the cut started
+} electrode_lift_t;
+
+/**
+ * @brief Initialize the scheduler, the first lift is due one period after now_ms
+ */
+void electrode_lift_init(electrode_lift_t *lift, const electrode_lift_config_t *config, uint32_t now_ms);
+
+/**
+ * @brief Restart the lift timer and short rate, call when a cut starts
+ */
+void electrode_lift_reset(electrode_lift_t *lift, uint32_t now_ms);
+
+/**
+ * @brief Feed one servo sample
+ *
+ * @param[in] lift Scheduler
+ * @param[in] short_or_arc true if the gap was classified as short or arc on this sample
+ */
+void electrode_lift_note_gap(electrode_lift_t *lift, bool short_or_arc);
+
+/**
+ * @brief Current lift interval, shortened from period_ms towards min_period_ms as the short rate climbs
+ */
+uint32_t electrode_lift_period_ms(const electrode_lift_t *lift);
+
+/**
+ * @brief Whether a lift should start now
+ */
+bool electrode_lift_due(const electrode_lift_t *lift, uint32_t now_ms);
+
+/**
+ * @brief Record a completed lift, the next one is scheduled from now_ms
+ */
+void electrode_lift_done(electrode_lift_t *lift, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
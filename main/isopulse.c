@@ -0,0 +1,28 @@
+#include "isopulse.h"
+
+static uint32_t ns_to_ticks(uint32_t ns, uint32_t resolution_hz)
+{
+    return (uint32_t)(((uint64_t)ns * resolution_hz + 500000000ULL) / 1000000000ULL);
+}
+
+bool isopulse_compute_timing(const isopulse_params_t *params, uint32_t resolution_hz, isopulse_timing_t *out_timing)
+{
+    if (!params || !out_timing || !resolution_hz) {
+        return false;
+    }
+    uint32_t wait_ticks = ns_to_ticks(params->max_ignition_delay_ns, resolution_hz);
+    uint32_t on_ticks = ns_to_ticks(params->on_time_ns, resolution_hz);
+    uint32_t off_ticks = ns_to_ticks(params->off_time_ns, resolution_hz);
+    // A zero wait leaves no window for ignition, zero on/off times collapse the pulse
+    if (wait_ticks == 0 || on_ticks == 0 || off_ticks == 0) {
+        return false;
+    }
+    uint64_t period = (uint64_t)wait_ticks + on_ticks + off_ticks;
+    if (period > ISOPULSE_MAX_PERIOD_TICKS) {
+        return false;
+    }
+    out_timing->sync_phase_ticks = wait_ticks;
+    out_timing->compare_ticks = wait_ticks + on_ticks;
+    out_timing->period_ticks = (uint32_t)period;
+    return true;
+}
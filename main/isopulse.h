@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Isopulse generator settings
+ *
+ * The high side turns on at the start of the period and waits for breakdown. The breakdown edge
+ * syncs the timer to a fixed phase, so the discharge always lasts on_time_ns from ignition,
+ * followed by off_time_ns. After max_ignition_delay_ns the timer passes the sync phase on its own;
+ * a breakdown before max_ignition_delay_ns + on_time_ns still reloads the sync phase and gets the
+ * full on time. Without breakdown by then the pulse ends at the compare as an open-circuit pulse.
+ *
+ * Only the first rising edge of a period syncs: the capture ISR disables the timer sync input and
+ * the TEZ callback re-enables it, so a re-strike or ringing edge during the discharge or the pause
+ * is ignored. Edges within the capture interrupt latency (a few us) of the first one still reload
+ * the counter.
+ */
+typedef struct {
+    uint32_t on_time_ns;            // Discharge duration measured from breakdown
+    uint32_t off_time_ns;           // Pause after each discharge (deionisation)
+    uint32_t max_ignition_delay_ns; // Open-circuit wait before the pulse is forced to run out
+} isopulse_params_t;
+
+/**
+ * @brief MCPWM timer values realising an isopulse_params_t
+ */
+typedef struct {
+    uint32_t sync_phase_ticks; // Counter value loaded on the breakdown sync
+    uint32_t compare_ticks;    // Compare value that ends the discharge
+    uint32_t period_ticks;     // Timer period, compare_ticks + off time
+} isopulse_timing_t;
+
+// MCPWM timers are 16 bit
+#define ISOPULSE_MAX_PERIOD_TICKS 65535
+
+/**
+ * @brief Convert isopulse settings into timer ticks
+ *
+ * @param[in] params Pulse settings
+ * @param[in] resolution_hz MCPWM timer resolution
+ * @param[out] out_timing Timer values
+ * @return false if a time rounds to zero ticks or the period does not fit the 16 bit timer
+ */
+bool isopulse_compute_timing(const isopulse_params_t *params, uint32_t resolution_hz, isopulse_timing_t *out_timing);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,13 +4,27 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <inttypes.h>
+#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/rmt_tx.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
 #include "stepper_motor_encoder.h"
+#include "electrode_lift.h"
+#include "cut_program.h"
+#include "stepper_curve.h"
+#include "session_recorder.h"
+#include "isopulse.h"
+#include "overcurrent_trip.h"
+#include "edm_link.h"
 #include "freertos/semphr.h"
+#if CONFIG_EDM_SIM_IO
+#include "sim_io.h"
+#endif
 
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
@@ -31,6 +45,8 @@
 #define START_CUT_GPIO    15
 
 #define STEP_MOTOR_RESOLUTION_HZ 1000000 // 1MHz resolution
+#define STEP_MOTOR_MEM_BLOCK_SYMBOLS 64  // RMT channel memory, moves made during a cut fit in it
+_Static_assert(STEPPER_UNIFORM_MAX_SYMBOLS <= STEP_MOTOR_MEM_BLOCK_SYMBOLS, "a feed step must fit the RMT channel memory");
 
 // Speed and leadscrew pitch settings
 double jog_speed_mm_per_s = 1; // Speed in mm/s, can be set from elsewhere
@@ -38,6 +54,15 @@ double cut_speed_mm_per_s = 0.1; // Speed in mm/s, can be set from elsewhere
 double leadscrew_pitch_mm = 4.0; // Leadscrew pitch in mm/rev
 double steps_per_rev = 200; // Pulses per revolution (e.g., 200 for 1.8 degree stepper)
 
+// Electrode lift (pecking) for flushing, overlaid on the gap servo. Profiles are built at startup.
+double lift_height_mm = 0.5;
+double lift_retract_speed_mm_per_s = 20;
+double lift_plunge_speed_mm_per_s = 10;
+uint32_t lift_period_ms = 2000;     // Lift interval at a clean gap, 0 disables lifting
+uint32_t lift_min_period_ms = 500;  // Interval when the short/arc rate reaches LIFT_SHORT_RATE_FULL
+#define LIFT_SHORT_RATE_FULL_PERMILLE 300 // 30% of servo samples short/arc -> lift at lift_min_period_ms
+#define LIFT_START_FREQ_HZ 100            // Step rate the lift profiles start and end at
+
 static const char *TAG = "main";
 
 #include "freertos/queue.h"
@@ -46,6 +71,7 @@ QueueHandle_t pwm_adc_queue = NULL;
 // Only extern variables that are defined in other files and actually used in main.c
 extern volatile uint32_t last_capture_ticks;
 extern volatile int adc_value_on_capture;
+extern volatile bool adc_filter_hold;
 extern SemaphoreHandle_t capture_semaphore;
 
 // Extern declaration for adc_on_capture_task (defined in ADC.c)
@@ -53,11 +79,431 @@ extern void adc_on_capture_task(void *pvParameters);
 extern void mcpwm_halfbridge_task(void *pvParameters);
 extern void adc_oneshot_init(void); // Add extern for ADC init
 
+// Pulse settings owned by MCPWM_task.c, written when a cut program stage starts
+extern volatile int duty_percent;
+extern volatile bool isopulse_enabled;
+extern void mcpwm_isopulse_publish(const isopulse_params_t *params, const isopulse_timing_t *timing);
+extern void mcpwm_isopulse_get(isopulse_params_t *out_params, isopulse_timing_t *out_timing);
+extern volatile uint32_t target_peak_current_ma;
+
+// Cut program, embedded from cut_program.txt and validated before the first cut
+extern const char cut_program_txt_start[] asm("_binary_cut_program_txt_start");
+static cut_program_t cut_program;
+static bool cut_program_ready = false;
+#define CUT_PROGRAM_PWM_RESOLUTION_HZ 10000000 // PWM_RESOLUTION_HZ in MCPWM_task.c
+
 // Local static/global variables (defined in this file and actually used)
 static rmt_channel_handle_t motor_chan;
 static rmt_encoder_handle_t accel_motor_encoder;
 static rmt_encoder_handle_t uniform_motor_encoder;
 static rmt_encoder_handle_t decel_motor_encoder;
+static rmt_encoder_handle_t jog_motor_encoder;
+volatile int32_t electrode_position_steps = 0; // Positive towards the workpiece, also read by sim_io.c
+
+// Servo settings, set per stage by the cut program and by the host link between stages
+static volatile int gap_low = 500;
+static volatile int gap_high = 2000;
+static volatile uint32_t feed_freq_hz = 0;
+static volatile bool cutting = false;
+
+// Button jog runs at a constant speed from a flat curve, one transmit is JOG_CURVE_POINTS steps.
+// The host link can retune it while the motor moves, see jog_curve_set().
+#define JOG_CURVE_POINTS 10
+#define JOG_FREQ_MIN_HZ 100
+#define JOG_FREQ_MAX_HZ 10000
+static volatile uint32_t jog_curve_freq_hz = 3000;
+
+// Host link requests, consumed by stepper_task
+#define REMOTE_JOG_MAX_STEPS 2000
+#define REMOTE_JOG_CHUNK_STEPS 10 // Limit switch is checked between chunks
+static volatile int remote_cut = 0;           // 1 start, -1 stop, 0 follow START_CUT_GPIO
+static volatile int32_t remote_jog_steps = 0; // Pending jog, positive towards the workpiece
+
+// Servo loop timing between performance reports (CONFIG_EDM_PERF_REPORT_MS)
+typedef struct {
+    int64_t last_start_us; // 0 after a lift, whose iteration is not a servo period
+    uint32_t count;
+    uint64_t period_sum_us;
+    uint32_t period_max_us;
+    uint64_t busy_sum_us;
+    uint32_t busy_max_us;
+} loop_perf_t;
+
+static void loop_perf_note(loop_perf_t *perf, int64_t start_us, int64_t end_us)
+{
+    if (perf->last_start_us) {
+        uint32_t period_us = (uint32_t)(start_us - perf->last_start_us);
+        uint32_t busy_us = (uint32_t)(end_us - start_us);
+        perf->count++;
+        perf->period_sum_us += period_us;
+        perf->busy_sum_us += busy_us;
+        perf->period_max_us = period_us > perf->period_max_us ? period_us : perf->period_max_us;
+        perf->busy_max_us = busy_us > perf->busy_max_us ? busy_us : perf->busy_max_us;
+    }
+    perf->last_start_us = start_us;
+}
+
+// One line per interval, parsed by pytest_edm_power.py
+static void loop_perf_report(loop_perf_t *perf)
+{
+    uint32_t count = perf->count ? perf->count : 1;
+    ESP_LOGI(TAG, "perf: loops=%" PRIu32 " period avg=%" PRIu32 " max=%" PRIu32 " us, busy avg=%" PRIu32 " max=%" PRIu32
+             " us, heap free=%u min=%u, stack free=%u, position=%" PRId32,
+             perf->count, (uint32_t)(perf->period_sum_us / count), perf->period_max_us, (uint32_t)(perf->busy_sum_us / count),
+             perf->busy_max_us, (unsigned)esp_get_free_heap_size(), (unsigned)esp_get_minimum_free_heap_size(),
+             (unsigned)uxTaskGetStackHighWaterMark(NULL), electrode_position_steps);
+    *perf = (loop_perf_t){ .last_start_us = perf->last_start_us };
+}
+
+// S-curve up to peak speed and back down, each half precomputed in a curve encoder table
+typedef struct {
+    rmt_encoder_handle_t accel;
+    rmt_encoder_handle_t decel;
+    uint32_t half_steps;
+} lift_profile_t;
+
+static lift_profile_t lift_retract_profile;
+static lift_profile_t lift_plunge_profile;
+
+static esp_err_t lift_profile_init(lift_profile_t *profile, uint32_t steps, double speed_mm_per_s)
+{
+    uint32_t peak_freq_hz = (uint32_t)stepper_calc_freq_from_speed(speed_mm_per_s, steps_per_rev, leadscrew_pitch_mm);
+    profile->half_steps = (steps + 1) / 2;
+    // One symbol per step: a half that fits the channel memory never waits on a refill during a flash stall
+    if (profile->half_steps > STEP_MOTOR_MEM_BLOCK_SYMBOLS) {
+        ESP_LOGE(TAG, "Lift of %" PRIu32 " steps exceeds %d steps per half", steps, STEP_MOTOR_MEM_BLOCK_SYMBOLS);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    stepper_motor_curve_encoder_config_t curve_config = {
+        .resolution = STEP_MOTOR_RESOLUTION_HZ,
+        .sample_points = profile->half_steps,
+        .start_freq_hz = LIFT_START_FREQ_HZ,
+        .end_freq_hz = peak_freq_hz,
+    };
+    esp_err_t err = rmt_new_stepper_motor_curve_encoder(&curve_config, &profile->accel);
+    if (err != ESP_OK) {
+        return err;
+    }
+    curve_config.start_freq_hz = peak_freq_hz;
+    curve_config.end_freq_hz = LIFT_START_FREQ_HZ;
+    err = rmt_new_stepper_motor_curve_encoder(&curve_config, &profile->decel);
+    if (err != ESP_OK) {
+        rmt_del_encoder(profile->accel);
+        profile->accel = NULL;
+    }
+    return err;
+}
+
+// Queue both halves back to back so the channel never idles at peak speed, returns steps moved
+static uint32_t lift_profile_move(const lift_profile_t *profile, int dir_level)
+{
+    rmt_transmit_config_t tx_config = { .loop_count = 0 };
+    uint32_t steps = profile->half_steps;
+    gpio_set_level(STEP_MOTOR_GPIO_DIR, dir_level);
+    ESP_ERROR_CHECK(rmt_transmit(motor_chan, profile->accel, &steps, sizeof(steps), &tx_config));
+    ESP_ERROR_CHECK(rmt_transmit(motor_chan, profile->decel, &steps, sizeof(steps), &tx_config));
+    ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+    return 2 * steps;
+}
+
+// Retract and plunge back by the same step count, the gap reading is frozen meanwhile so the
+// servo resumes from its pre-lift state
+static void electrode_lift_cycle(void)
+{
+    int32_t start_position = electrode_position_steps;
+    adc_filter_hold = true;
+    electrode_position_steps -= (int32_t)lift_profile_move(&lift_retract_profile, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
+    electrode_position_steps += (int32_t)lift_profile_move(&lift_plunge_profile, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
+    adc_filter_hold = false;
+    if (electrode_position_steps != start_position) {
+        ESP_LOGE(TAG, "Lift did not return to start: %ld != %ld", (long)electrode_position_steps, (long)start_position);
+    }
+}
+
+static void cut_program_load(const char *text)
+{
+    cut_stage_t defaults = {
+        .feed_speed_mm_per_s = cut_speed_mm_per_s,
+        .duty_percent = 40,
+        .gap_low = 500,   // adjust based on your ADC scaling
+        .gap_high = 2000, // adjust based on your ADC scaling
+        .lift_period_ms = lift_period_ms,
+        .lift_min_period_ms = lift_min_period_ms,
+    };
+    char err[64];
+    cut_program_ready = cut_program_parse(text, &defaults, &cut_program, err, sizeof(err)) &&
+                        cut_program_prepare(&cut_program, steps_per_rev / leadscrew_pitch_mm, STEP_MOTOR_RESOLUTION_HZ,
+                                                            CUT_PROGRAM_PWM_RESOLUTION_HZ, err, sizeof(err));
+    if (!cut_program_ready) {
+        ESP_LOGE(TAG, "Cut program rejected: %s", err);
+        return;
+    }
+    ESP_LOGI(TAG, "Cut program loaded: %u stages, final depth %.3f mm", (unsigned)cut_program.num_stages,
+             cut_program.stages[cut_program.num_stages - 1].target_depth_mm);
+}
+
+// Stage change: only copies values cut_program_prepare() already validated
+static void cut_stage_apply(const cut_stage_t *stage, electrode_lift_t *lift)
+{
+    gap_low = stage->gap_low;
+    gap_high = stage->gap_high;
+    feed_freq_hz = stage->feed_freq_hz;
+    if (lift_period_ms) { // 0 here means the lift profiles could not be built
+        lift->config.period_ms = stage->lift_period_ms;
+        lift->config.min_period_ms = stage->lift_min_period_ms;
+    }
+    if (stage->on_time_ns) {
+        isopulse_params_t params = {
+            .on_time_ns = stage->on_time_ns,
+            .off_time_ns = stage->off_time_ns,
+            .max_ignition_delay_ns = stage->max_ignition_ns,
+        };
+        mcpwm_isopulse_publish(&params, &stage->isopulse); // before the enable, so it never sees a stale set
+        isopulse_enabled = true;
+    } else {
+        isopulse_enabled = false;
+        duty_percent = stage->duty_percent;
+    }
+}
+
+// Pulse class for the session recorder, from where the gap sits relative to the servo window
+static uint8_t classify_gap(int gap_voltage, int gap_low, int gap_high)
+{
+    if (gap_voltage < gap_low / 2) {
+        return SESSION_PULSE_SHORT;
+    } else if (gap_voltage < gap_low) {
+        return SESSION_PULSE_ARC;
+    } else if (gap_voltage > gap_high) {
+        return SESSION_PULSE_OPEN;
+    }
+    return SESSION_PULSE_NORMAL;
+}
+
+static void jog_curve_config(uint32_t freq_hz, stepper_motor_curve_encoder_config_t *out_config)
+{
+    *out_config = (stepper_motor_curve_encoder_config_t) {
+        .resolution = STEP_MOTOR_RESOLUTION_HZ,
+        .sample_points = JOG_CURVE_POINTS,
+        .start_freq_hz = freq_hz,
+        .end_freq_hz = freq_hz - JOG_CURVE_POINTS, // must differ by at least sample_points, close enough to flat
+    };
+}
+
+// Rebuild the jog curve in the encoder's spare table and swap it in. Safe while jogging: the
+// transmit in flight keeps its curve, the next one picks up the new speed.
+static esp_err_t jog_curve_set(uint32_t freq_hz)
+{
+    if (freq_hz < JOG_FREQ_MIN_HZ || freq_hz > JOG_FREQ_MAX_HZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!jog_motor_encoder) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    stepper_motor_curve_encoder_config_t config;
+    jog_curve_config(freq_hz, &config);
+    esp_err_t err = rmt_stepper_motor_curve_encoder_prepare(jog_motor_encoder, &config);
+    if (err != ESP_OK) {
+        return err;
+    }
+    rmt_stepper_motor_curve_encoder_swap(jog_motor_encoder);
+    jog_curve_freq_hz = freq_hz;
+    return ESP_OK;
+}
+
+static bool link_get_param(uint8_t id, int32_t *out_value, void *ctx)
+{
+    overcurrent_trip_stats_t trip_stats;
+    isopulse_params_t pulse;
+    mcpwm_isopulse_get(&pulse, NULL);
+    switch (id) {
+    case EDM_PARAM_DUTY_PERCENT:
+        *out_value = duty_percent;
+        return true;
+    case EDM_PARAM_CUT_SPEED_UM_S:
+        *out_value = (int32_t)lround(feed_freq_hz * leadscrew_pitch_mm / steps_per_rev * 1000);
+        return true;
+    case EDM_PARAM_GAP_LOW:
+        *out_value = gap_low;
+        return true;
+    case EDM_PARAM_GAP_HIGH:
+        *out_value = gap_high;
+        return true;
+    case EDM_PARAM_ISOPULSE_ENABLE:
+        *out_value = isopulse_enabled;
+        return true;
+    case EDM_PARAM_ISOPULSE_ON_NS:
+        *out_value = pulse.on_time_ns;
+        return true;
+    case EDM_PARAM_ISOPULSE_OFF_NS:
+        *out_value = pulse.off_time_ns;
+        return true;
+    case EDM_PARAM_ISOPULSE_IGNITION_NS:
+        *out_value = pulse.max_ignition_delay_ns;
+        return true;
+    case EDM_PARAM_TELEMETRY_HZ:
+        *out_value = edm_link_get_telemetry_hz();
+        return true;
+    case EDM_PARAM_JOG_SPEED_UM_S:
+        *out_value = (int32_t)lround(jog_curve_freq_hz * leadscrew_pitch_mm / steps_per_rev * 1000);
+        return true;
+    case EDM_PARAM_PEAK_CURRENT_MA:
+        *out_value = target_peak_current_ma;
+        return true;
+    case EDM_PARAM_TRIP_COUNT:
+    case EDM_PARAM_TRIP_CBC_CYCLES:
+    case EDM_PARAM_TRIP_OST_LATCHES:
+    case EDM_PARAM_TRIP_LATCHED:
+        overcurrent_trip_get_stats(&trip_stats);
+        *out_value = id == EDM_PARAM_TRIP_COUNT ? (int32_t)trip_stats.trips :
+                     id == EDM_PARAM_TRIP_CBC_CYCLES ? (int32_t)trip_stats.cbc_cycles :
+                     id == EDM_PARAM_TRIP_OST_LATCHES ? (int32_t)trip_stats.ost_latches : trip_stats.latched;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Called from the link task. Values hold until the next cut program stage change.
+static uint8_t link_set_param(uint8_t id, int32_t value, void *ctx)
+{
+    isopulse_params_t pulse;
+    isopulse_timing_t timing;
+    mcpwm_isopulse_get(&pulse, NULL);
+    switch (id) {
+    case EDM_PARAM_DUTY_PERCENT:
+        if (value < 0 || value > 100) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        duty_percent = value;
+        return 0;
+    case EDM_PARAM_CUT_SPEED_UM_S: {
+        double freq_hz = stepper_calc_freq_from_speed(value / 1000.0, steps_per_rev, leadscrew_pitch_mm);
+        // Slower feeds need more symbols per step than the uniform encoder holds
+        if (value <= 0 || value > jog_speed_mm_per_s * 1000 || freq_hz < stepper_uniform_min_freq_hz(STEP_MOTOR_RESOLUTION_HZ)) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        cut_speed_mm_per_s = value / 1000.0;
+        feed_freq_hz = (uint32_t)freq_hz;
+        return 0;
+    }
+    case EDM_PARAM_GAP_LOW:
+        if (value < 0 || value >= gap_high) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        gap_low = value;
+        return 0;
+    case EDM_PARAM_GAP_HIGH:
+        if (value <= gap_low || value > 4095) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        gap_high = value;
+        return 0;
+    case EDM_PARAM_ISOPULSE_ENABLE:
+        // The published setting was validated when it was published
+        isopulse_enabled = value != 0;
+        return 0;
+    case EDM_PARAM_ISOPULSE_ON_NS:
+    case EDM_PARAM_ISOPULSE_OFF_NS:
+    case EDM_PARAM_ISOPULSE_IGNITION_NS:
+        if (value <= 0) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        if (id == EDM_PARAM_ISOPULSE_ON_NS) {
+            pulse.on_time_ns = value;
+        } else if (id == EDM_PARAM_ISOPULSE_OFF_NS) {
+            pulse.off_time_ns = value;
+        } else {
+            pulse.max_ignition_delay_ns = value;
+        }
+        // Validate the whole set so the MCPWM task never sees timings it has to reject
+        if (!isopulse_compute_timing(&pulse, CUT_PROGRAM_PWM_RESOLUTION_HZ, &timing)) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        mcpwm_isopulse_publish(&pulse, &timing);
+        return 0;
+    case EDM_PARAM_TELEMETRY_HZ:
+        if (value < 0 || edm_link_set_telemetry_hz(value) != ESP_OK) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        return 0;
+    case EDM_PARAM_JOG_SPEED_UM_S: {
+        if (value <= 0) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        esp_err_t err = jog_curve_set((uint32_t)stepper_calc_freq_from_speed(value / 1000.0, steps_per_rev, leadscrew_pitch_mm));
+        if (err == ESP_ERR_INVALID_STATE) {
+            return EDM_PROTO_NACK_BUSY;
+        }
+        return err == ESP_OK ? 0 : EDM_PROTO_NACK_OUT_OF_RANGE;
+    }
+    case EDM_PARAM_PEAK_CURRENT_MA:
+        if (value < 0 || value > 40000) { // CURRENT_SENSE_FULL_SCALE_MA
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        target_peak_current_ma = value;
+        return 0;
+    case EDM_PARAM_TRIP_COUNT:
+    case EDM_PARAM_TRIP_CBC_CYCLES:
+    case EDM_PARAM_TRIP_OST_LATCHES:
+    case EDM_PARAM_TRIP_LATCHED:
+        return EDM_PROTO_NACK_READ_ONLY;
+    default:
+        return EDM_PROTO_NACK_UNKNOWN_PARAM;
+    }
+}
+
+static uint8_t link_command(uint8_t command, int32_t arg, void *ctx)
+{
+    switch (command) {
+    case EDM_CMD_START:
+        remote_cut = 1;
+        return 0;
+    case EDM_CMD_STOP:
+        remote_cut = -1;
+        return 0;
+    case EDM_CMD_JOG:
+        if (cutting || remote_jog_steps) {
+            return EDM_PROTO_NACK_BUSY;
+        }
+        if (arg == 0 || arg > REMOTE_JOG_MAX_STEPS || arg < -REMOTE_JOG_MAX_STEPS) {
+            return EDM_PROTO_NACK_OUT_OF_RANGE;
+        }
+        remote_jog_steps = arg;
+        return 0;
+    case EDM_CMD_CLEAR_TRIP: {
+        esp_err_t err = overcurrent_trip_clear_latch();
+        if (err == ESP_ERR_INVALID_STATE) {
+            return EDM_PROTO_NACK_BUSY; // fault input still active, or the trip is not set up yet
+        }
+        return err == ESP_OK ? 0 : EDM_PROTO_NACK_OUT_OF_RANGE;
+    }
+    default:
+        return EDM_PROTO_NACK_UNKNOWN_COMMAND;
+    }
+}
+
+static const edm_proto_handlers_t link_handlers = {
+    .get_param = link_get_param,
+    .set_param = link_set_param,
+    .command = link_command,
+};
+
+// Host requested jog, one uniform encoder step per transmit at the jog frequency
+static void remote_jog_move(int32_t steps, uint32_t freq_hz)
+{
+    rmt_transmit_config_t tx_config = { .loop_count = 0 };
+    int dir = steps > 0 ? 1 : -1;
+    gpio_set_level(STEP_MOTOR_GPIO_DIR, dir > 0 ? STEP_MOTOR_SPIN_DIR_CLOCKWISE : STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
+    for (int32_t remaining = steps * dir; remaining > 0 && gpio_get_level(LIMIT_SWITCH_GPIO);) {
+        int32_t chunk = remaining < REMOTE_JOG_CHUNK_STEPS ? remaining : REMOTE_JOG_CHUNK_STEPS;
+        for (int32_t i = 0; i < chunk; i++) {
+            ESP_ERROR_CHECK(rmt_transmit(motor_chan, uniform_motor_encoder, &freq_hz, sizeof(freq_hz), &tx_config));
+        }
+        ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+        electrode_position_steps += dir * chunk;
+        remaining -= chunk;
+    }
+}
 
 // The task function
 void stepper_task(void *pvParameters)
@@ -107,7 +553,7 @@ void stepper_task(void *pvParameters)
     rmt_tx_channel_config_t tx_chan_config = {
         .clk_src = RMT_CLK_SRC_DEFAULT, // select clock source
         .gpio_num = STEP_MOTOR_GPIO_STEP,
-        .mem_block_symbols = 64,
+        .mem_block_symbols = STEP_MOTOR_MEM_BLOCK_SYMBOLS,
         .resolution_hz = STEP_MOTOR_RESOLUTION_HZ,
         .trans_queue_depth = 10, // set the number of transactions that can be pending in the background
     };
@@ -131,13 +577,9 @@ void stepper_task(void *pvParameters)
     }
 
     // Jog encoder: use curve encoder for configurable jog speed
-    static rmt_encoder_handle_t jog_motor_encoder = NULL;
-    stepper_motor_curve_encoder_config_t jog_curve_config = {0};
-    jog_curve_config.resolution = STEP_MOTOR_RESOLUTION_HZ;
-    jog_curve_config.sample_points = 2; // For constant speed, must be <= |start_freq_hz - end_freq_hz|
-    jog_curve_config.start_freq_hz = 3000; // Set jog speed here (Hz)
-    jog_curve_config.end_freq_hz = 2998;   // Must not be equal to start_freq_hz, and difference >= sample_points
-    ESP_ERROR_CHECK(rmt_new_stepper_motor_curve_encoder(&jog_curve_config, &jog_motor_encoder));
+    stepper_motor_curve_encoder_config_t jog_encoder_config;
+    jog_curve_config(jog_curve_freq_hz, &jog_encoder_config);
+    ESP_ERROR_CHECK(rmt_new_stepper_motor_curve_encoder(&jog_encoder_config, &jog_motor_encoder));
     if (jog_motor_encoder == NULL) {
         ESP_LOGE(TAG, "Failed to create jog_motor_encoder");
         return;
@@ -162,6 +604,31 @@ void stepper_task(void *pvParameters)
         return;
     }
 
+    ESP_LOGI(TAG, "Create electrode lift profiles");
+    uint32_t lift_steps = (uint32_t)(lift_height_mm / leadscrew_pitch_mm * steps_per_rev);
+    if (lift_period_ms && (lift_profile_init(&lift_retract_profile, lift_steps, lift_retract_speed_mm_per_s) != ESP_OK ||
+                           lift_profile_init(&lift_plunge_profile, lift_steps, lift_plunge_speed_mm_per_s) != ESP_OK)) {
+        ESP_LOGE(TAG, "Invalid lift profile (height %.2f mm), electrode lift disabled", lift_height_mm);
+        lift_period_ms = 0;
+    }
+    electrode_lift_t lift;
+    electrode_lift_config_t lift_config = {
+        .period_ms = lift_period_ms,
+        .min_period_ms = lift_min_period_ms,
+        .short_rate_full_permille = LIFT_SHORT_RATE_FULL_PERMILLE,
+        .rate_filter_shift = 4,
+    };
+    electrode_lift_init(&lift, &lift_config, pdTICKS_TO_MS(xTaskGetTickCount()));
+
+    cut_program_load(cut_program_txt_start);
+    // A run spans pauses (stop, jog, limit, remote stop): the executor and the absolute start
+    // position are kept until the program completes and the start is released
+    cut_program_exec_t program_exec = {0};
+    bool run_active = false;
+    int32_t cut_start_position = 0;
+    uint32_t last_progress_ms = 0;
+    feed_freq_hz = (uint32_t)cut_freq_hz;
+
     ESP_LOGI(TAG, "Enable RMT channel");
     // Debug: print motor_chan handle before enabling
     ESP_LOGI(TAG, "motor_chan handle: %p", motor_chan);
@@ -173,19 +640,42 @@ void stepper_task(void *pvParameters)
     // Variable declarations moved to function scope
     extern volatile uint32_t last_capture_ticks;
     extern volatile int adc_value_on_capture;
-    const int LOW_VOLTAGE = 500;            // adjust based on your ADC scaling
-    const int HIGH_VOLTAGE = 2000;          // adjust based on your ADC scaling
 
     // ESP_LOGI(TAG, "RMT channel enabled, entering main loop");
 
     rmt_transmit_config_t tx_config = { .loop_count = 0 };
     int jogging = 0; // 0: not jogging, 1: up, -1: down
     bool encoder_running = false; // Track if encoder is running
+    int last_start_switch = gpio_get_level(START_CUT_GPIO);
+    loop_perf_t perf = {0};
+    uint32_t last_perf_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+    ESP_LOGI(TAG, "Ready, %" PRIu32 " ms after boot", (uint32_t)(esp_timer_get_time() / 1000));
     while (1) {
+        int64_t loop_start_us = esp_timer_get_time();
         int jog_up = gpio_get_level(JOG_UP_GPIO);
         int jog_down = gpio_get_level(JOG_DOWN_GPIO);
         int limit_switch = gpio_get_level(LIMIT_SWITCH_GPIO); // 1 = OK, 0 = limit hit
-        int start_cut = gpio_get_level(START_CUT_GPIO);       // 1 = start, 0 = stop
+        int start_switch = gpio_get_level(START_CUT_GPIO);    // 1 = start, 0 = stop
+        if (start_switch != last_start_switch) {
+            remote_cut = 0; // Flipping the switch takes control back from the host
+            last_start_switch = start_switch;
+        }
+        int start_cut = remote_cut ? remote_cut > 0 : start_switch;
+        uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        if (CONFIG_EDM_PERF_REPORT_MS && now_ms - last_perf_ms >= CONFIG_EDM_PERF_REPORT_MS) {
+            loop_perf_report(&perf);
+            last_perf_ms = now_ms;
+        }
+        if (cutting && (!limit_switch || jog_up || jog_down || !start_cut)) {
+            session_recorder_flush();
+            cutting = false;
+            if (!program_exec.done) {
+                ESP_LOGI(TAG, "Cut paused at %.3f mm", (electrode_position_steps - cut_start_position) * leadscrew_pitch_mm / steps_per_rev);
+            }
+        }
+        if (run_active && program_exec.done && !start_cut) {
+            run_active = false; // the next start begins a new run from the electrode position
+        }
 
       
         // If limit switch is OFF, inhibit all movement
@@ -206,10 +696,11 @@ void stepper_task(void *pvParameters)
             ESP_LOGI(TAG, "Jog UP pressed");
             jogging = 1;
             gpio_set_level(STEP_MOTOR_GPIO_DIR, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE); // Retract direction
-            uint32_t steps = 10; // More steps for faster jog
+            uint32_t steps = JOG_CURVE_POINTS; // More steps for faster jog
             ESP_LOGI(TAG, "Jog UP: accel phase");
             ESP_ERROR_CHECK(rmt_transmit(motor_chan, accel_motor_encoder, &steps, sizeof(steps), &tx_config));
             ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+            electrode_position_steps -= steps;
             encoder_running = true;
             // Keep jogging at constant speed while button is held
             while (gpio_get_level(JOG_UP_GPIO) && gpio_get_level(LIMIT_SWITCH_GPIO)) {
@@ -218,21 +709,24 @@ void stepper_task(void *pvParameters)
                 //ESP_ERROR_CHECK(rmt_transmit(motor_chan, uniform_motor_encoder, &uniform_speed_hz, sizeof(uniform_speed_hz), &tx_config));
                ESP_ERROR_CHECK(rmt_transmit(motor_chan, jog_motor_encoder, &steps, sizeof(steps), &tx_config));
                 ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+                electrode_position_steps -= steps;
                 vTaskDelay(pdMS_TO_TICKS(1));
             }
             ESP_LOGI(TAG, "Jog UP: decel phase");
             steps = 10;
             ESP_ERROR_CHECK(rmt_transmit(motor_chan, decel_motor_encoder, &steps, sizeof(steps), &tx_config));
             ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+            electrode_position_steps -= steps;
             jogging = 0;
         } else if (jog_down) {
             ESP_LOGI(TAG, "Jog DOWN pressed");
             jogging = -1;
             gpio_set_level(STEP_MOTOR_GPIO_DIR, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
-            uint32_t steps = 10; // More steps for faster jog
+            uint32_t steps = JOG_CURVE_POINTS; // More steps for faster jog
             ESP_LOGI(TAG, "Jog DOWN: accel phase");
             ESP_ERROR_CHECK(rmt_transmit(motor_chan, accel_motor_encoder, &steps, sizeof(steps), &tx_config));
             ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+            electrode_position_steps += steps;
             encoder_running = true;
             // Keep jogging at constant speed while button is held
             while (gpio_get_level(JOG_DOWN_GPIO) && gpio_get_level(LIMIT_SWITCH_GPIO)) {
@@ -241,35 +735,115 @@ void stepper_task(void *pvParameters)
                 ESP_ERROR_CHECK(rmt_transmit(motor_chan, jog_motor_encoder, &steps, sizeof(steps), &tx_config));
                 //ESP_ERROR_CHECK(rmt_transmit(motor_chan, jog_motor_encoder, &steps, sizeof(steps), &tx_config));
                 ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+                electrode_position_steps += steps;
                 vTaskDelay(pdMS_TO_TICKS(1));
             }
             ESP_LOGI(TAG, "Jog DOWN: decel phase");
             steps = 10;
             ESP_ERROR_CHECK(rmt_transmit(motor_chan, decel_motor_encoder, &steps, sizeof(steps), &tx_config));
             ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+            electrode_position_steps += steps;
             encoder_running = true;
             jogging = 0;
+        } else if (remote_jog_steps && !cutting) {
+            ESP_LOGI(TAG, "Remote jog %ld steps", (long)remote_jog_steps);
+            remote_jog_move(remote_jog_steps, jog_curve_freq_hz);
+            remote_jog_steps = 0;
         } else if (!jogging && limit_switch && start_cut) {
-            ESP_LOGI(TAG, "Start EDM cut");
+            if (!cutting) {
+                if (!cut_program_ready) {
+                    ESP_LOGE(TAG, "No valid cut program, not cutting");
+                    vTaskDelay(pdMS_TO_TICKS(500));
+                    continue;
+                }
+                if (!run_active) {
+                    ESP_LOGI(TAG, "Start EDM cut");
+                    cut_start_position = electrode_position_steps;
+                    cut_program_start(&program_exec, &cut_program, now_ms);
+                    session_recorder_session_start();
+                    run_active = true;
+                } else {
+                    ESP_LOGI(TAG, "Resume EDM cut, stage %u/%u", (unsigned)program_exec.stage + 1, (unsigned)cut_program.num_stages);
+                    cut_program_resume(&program_exec, electrode_position_steps - cut_start_position, now_ms);
+                }
+                if (!program_exec.done) {
+                    cut_stage_apply(cut_program_current_stage(&program_exec), &lift);
+                }
+                electrode_lift_reset(&lift, now_ms);
+                last_progress_ms = now_ms;
+                perf.last_start_us = 0;
+                cutting = true;
+            }
+            int32_t depth_steps = electrode_position_steps - cut_start_position;
+            if (program_exec.done) {
+                // Program finished, hold until the start switch is released
+                vTaskDelay(pdMS_TO_TICKS(20));
+                continue;
+            }
+            if (cut_program_update(&program_exec, depth_steps, now_ms)) {
+                const cut_stage_t *stage = cut_program_current_stage(&program_exec);
+                if (stage) {
+                    ESP_LOGI(TAG, "Cut program: stage %u/%u", (unsigned)program_exec.stage + 1, (unsigned)cut_program.num_stages);
+                    cut_stage_apply(stage, &lift);
+                } else {
+                    ESP_LOGI(TAG, "Cut program complete at %.3f mm", depth_steps * leadscrew_pitch_mm / steps_per_rev);
+                    session_recorder_flush();
+                    continue;
+                }
+            }
+            if (now_ms - last_progress_ms >= 1000) {
+                cut_program_progress_t progress;
+                cut_program_get_progress(&program_exec, depth_steps, steps_per_rev / leadscrew_pitch_mm, &progress);
+                if (progress.eta_valid) {
+                    ESP_LOGI(TAG, "Cut progress: stage %u/%u, %.3f/%.3f mm (%.1f%%), %.3f mm/min, ETA %" PRIu32 " s",
+                             (unsigned)progress.stage + 1, (unsigned)progress.num_stages, progress.depth_mm, progress.target_depth_mm,
+                             progress.percent, progress.rate_mm_per_min, progress.eta_s);
+                } else {
+                    ESP_LOGI(TAG, "Cut progress: stage %u/%u, %.3f/%.3f mm (%.1f%%), ETA unknown",
+                             (unsigned)progress.stage + 1, (unsigned)progress.num_stages, progress.depth_mm, progress.target_depth_mm,
+                             progress.percent);
+                }
+                last_progress_ms = now_ms;
+            }
             // int delay_ticks = 0; // Removed: delay_ticks no longer used
             int gap_voltage = adc_value_on_capture;
             ESP_LOGI(TAG, "DEBUG: gap_voltage=%d", gap_voltage); // Debug print
+            electrode_lift_note_gap(&lift, gap_voltage < gap_low);
+            session_sample_t sample = {
+                .time_ms = now_ms,
+                .position_steps = electrode_position_steps,
+                .gap_adc = gap_voltage,
+                .pulse_class = classify_gap(gap_voltage, gap_low, gap_high),
+            };
+            if (electrode_lift_due(&lift, now_ms)) {
+                ESP_LOGI(TAG, "EDM: electrode lift, interval %" PRIu32 " ms", electrode_lift_period_ms(&lift));
+                sample.servo = SESSION_SERVO_LIFT;
+                session_recorder_log(&sample);
+                edm_link_telemetry(&sample);
+                electrode_lift_cycle();
+                electrode_lift_done(&lift, pdTICKS_TO_MS(xTaskGetTickCount()));
+                perf.last_start_us = 0;
+                continue;
+            }
             // Control logic
             int step_direction = 0;
-            if (gap_voltage < LOW_VOLTAGE) {
+            if (gap_voltage < gap_low) {
                 step_direction = -1;
                  ESP_LOGI(TAG, "EDM: Too close, retracting electrode");
-            } else if (gap_voltage > HIGH_VOLTAGE) {
+            } else if (gap_voltage > gap_high) {
                 step_direction = 1;
                  ESP_LOGI(TAG, "EDM: Too far, advancing electrode");
             } else {
                 step_direction = 0;
                  ESP_LOGI(TAG, "EDM: Gap OK, holding position");
             }
+            sample.servo = step_direction;
+            session_recorder_log(&sample);
+            edm_link_telemetry(&sample);
             // Move stepper based on step_direction
             if (step_direction == -1) {
                 gpio_set_level(STEP_MOTOR_GPIO_DIR, STEP_MOTOR_SPIN_DIR_COUNTERCLOCKWISE);
-                uint32_t steps = 5;
+                uint32_t steps = feed_freq_hz; // uniform encoder takes the step frequency
                 if (motor_chan == NULL || uniform_motor_encoder == NULL) {
                     ESP_LOGE(TAG, "motor_chan or uniform_motor_encoder is NULL!");
                 } else {
@@ -278,11 +852,12 @@ void stepper_task(void *pvParameters)
                         ESP_LOGE(TAG, "rmt_transmit failed: %s", esp_err_to_name(tx_err));
                     }
                     ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+                    electrode_position_steps--; // uniform encoder emits a single step per transmit
                 }
                 encoder_running = true;
             } else if (step_direction == 1) {
                 gpio_set_level(STEP_MOTOR_GPIO_DIR, STEP_MOTOR_SPIN_DIR_CLOCKWISE);
-                uint32_t steps = 5;
+                uint32_t steps = feed_freq_hz; // uniform encoder takes the step frequency
                 if (motor_chan == NULL || uniform_motor_encoder == NULL) {
                     ESP_LOGE(TAG, "motor_chan or uniform_motor_encoder is NULL!");
                 } else {
@@ -291,9 +866,11 @@ void stepper_task(void *pvParameters)
                         ESP_LOGE(TAG, "rmt_transmit failed: %s", esp_err_to_name(tx_err));
                     }
                     ESP_ERROR_CHECK(rmt_tx_wait_all_done(motor_chan, -1));
+                    electrode_position_steps++;
                 }
                 encoder_running = true;
             } // else hold (do nothing)
+            loop_perf_note(&perf, loop_start_us, esp_timer_get_time());
             vTaskDelay(pdMS_TO_TICKS(20)); // Always yield to avoid WDT
         }
     }
@@ -303,6 +880,22 @@ void stepper_task(void *pvParameters)
 void app_main(void)
 {
     pwm_adc_queue = xQueueCreate(1, sizeof(int));
+    // Before the stepper task, which logs cut samples into it
+    if (session_recorder_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Cut session recorder not available");
+    }
+    if (edm_link_init(&link_handlers) != ESP_OK) {
+        ESP_LOGW(TAG, "Host link not available");
+    }
+#if CONFIG_EDM_SIM_IO
+    sim_io_config_t sim_config = {
+        .jog_up_gpio = JOG_UP_GPIO,
+        .jog_down_gpio = JOG_DOWN_GPIO,
+        .limit_switch_gpio = LIMIT_SWITCH_GPIO,
+        .start_cut_gpio = START_CUT_GPIO,
+    };
+    ESP_ERROR_CHECK(sim_io_start(&sim_config));
+#endif
     // Create the task
     xTaskCreate(stepper_task, "stepper_task", 4096, NULL, 5, NULL);
     ESP_LOGI(TAG, "Stepper motor example started");
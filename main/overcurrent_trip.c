@@ -0,0 +1,224 @@
+#include "driver/mcpwm_prelude.h"
+#include "driver/gpio.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "overcurrent_trip.h"
+
+static const char *TAG = "overcurrent";
+
+// A PWM0A falling edge further than this from the fault edge is a normal compare edge, not the brake
+#define TRIP_MATCH_WINDOW_NS 1000
+
+static mcpwm_oper_handle_t trip_oper = NULL;
+static mcpwm_fault_handle_t trip_fault = NULL;
+static int trip_fault_gpio = -1;
+static bool trip_fault_active_high = true;
+
+// Written from the MCPWM ISRs only
+static volatile uint32_t trip_count = 0;
+static volatile uint32_t cbc_cycle_count = 0;
+static volatile uint32_t ost_latch_count = 0;
+static volatile bool ost_latched = false;
+
+// Latency probe, all in capture timer ticks. Both capture ISRs run at the same level on the
+// same core, so whichever runs second does the matching and neither can preempt the other.
+static uint32_t cap_resolution_hz = 0;
+static uint32_t match_window_ticks = 0;
+static volatile uint32_t trip_edge_ticks = 0;
+static volatile uint32_t a_fall_ticks = 0;
+static volatile uint32_t matched_latency_ticks = 0;
+static volatile bool trip_matched = false;
+
+// Task side bookkeeping for overcurrent_trip_poll()
+static uint32_t seen_trip_count = 0;
+static uint32_t already_off_count = 0;
+static uint32_t last_latency_ns = 0;
+static uint32_t max_latency_ns = 0;
+
+static bool IRAM_ATTR fault_enter_cb(mcpwm_fault_handle_t fault, const mcpwm_fault_event_data_t *edata, void *user_data)
+{
+    trip_count++;
+    return false;
+}
+
+static bool IRAM_ATTR brake_cbc_cb(mcpwm_oper_handle_t oper, const mcpwm_brake_event_data_t *edata, void *user_data)
+{
+    cbc_cycle_count++;
+    return false;
+}
+
+static bool IRAM_ATTR brake_ost_cb(mcpwm_oper_handle_t oper, const mcpwm_brake_event_data_t *edata, void *user_data)
+{
+    if (!ost_latched) {
+        ost_latched = true;
+        ost_latch_count++;
+    }
+    return false;
+}
+
+static bool IRAM_ATTR fault_edge_capture_cb(mcpwm_cap_channel_handle_t cap_chan, const mcpwm_capture_event_data_t *edata, void *user_data)
+{
+    trip_edge_ticks = edata->cap_value;
+    trip_matched = false;
+    uint32_t delta = a_fall_ticks - edata->cap_value;
+    if (delta < match_window_ticks) {
+        matched_latency_ticks = delta;
+        trip_matched = true;
+    }
+    return false;
+}
+
+static bool IRAM_ATTR pwm_a_fall_capture_cb(mcpwm_cap_channel_handle_t cap_chan, const mcpwm_capture_event_data_t *edata, void *user_data)
+{
+    a_fall_ticks = edata->cap_value;
+    uint32_t delta = edata->cap_value - trip_edge_ticks;
+    if (!trip_matched && delta < match_window_ticks) {
+        matched_latency_ticks = delta;
+        trip_matched = true;
+    }
+    return false;
+}
+
+esp_err_t overcurrent_trip_init(const overcurrent_trip_config_t *config, mcpwm_oper_handle_t oper, mcpwm_gen_handle_t gen_a, mcpwm_gen_handle_t gen_b)
+{
+    ESP_RETURN_ON_FALSE(config && oper && gen_a && gen_b, ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+
+    mcpwm_gpio_fault_config_t fault_config = {
+        .group_id = 0,
+        .gpio_num = config->fault_gpio_num,
+        .flags.active_level = config->fault_active_high,
+        .flags.pull_down = config->fault_active_high, // idle the input at its inactive level when nothing is connected
+        .flags.pull_up = !config->fault_active_high,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_new_gpio_fault(&fault_config, &trip_fault), TAG, "create gpio fault failed");
+    trip_oper = oper;
+    trip_fault_gpio = config->fault_gpio_num;
+    trip_fault_active_high = config->fault_active_high;
+
+    // Safe state is both switches off. The fault handler sits after the dead time stage, so this
+    // holds for gen_b even though its waveform is derived from gen_a.
+    mcpwm_gen_handle_t gens[] = { gen_a, gen_b };
+    for (int i = 0; i < 2; i++) {
+        ESP_RETURN_ON_ERROR(mcpwm_generator_set_action_on_brake_event(gens[i],
+                            MCPWM_GEN_BRAKE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, MCPWM_OPER_BRAKE_MODE_CBC, MCPWM_GEN_ACTION_LOW)),
+                            TAG, "set cbc brake action failed");
+        ESP_RETURN_ON_ERROR(mcpwm_generator_set_action_on_brake_event(gens[i],
+                            MCPWM_GEN_BRAKE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, MCPWM_OPER_BRAKE_MODE_OST, MCPWM_GEN_ACTION_LOW)),
+                            TAG, "set ost brake action failed");
+    }
+
+    ESP_RETURN_ON_ERROR(mcpwm_fault_register_event_callbacks(trip_fault, &(mcpwm_fault_event_callbacks_t){
+        .on_fault_enter = fault_enter_cb,
+    }, NULL), TAG, "register fault callbacks failed");
+    ESP_RETURN_ON_ERROR(mcpwm_operator_register_event_callbacks(oper, &(mcpwm_operator_event_callbacks_t){
+        .on_brake_cbc = brake_cbc_cb,
+        .on_brake_ost = brake_ost_cb,
+    }, NULL), TAG, "register brake callbacks failed");
+
+    ESP_RETURN_ON_ERROR(overcurrent_trip_set_mode(config->mode), TAG, "set trip mode failed");
+    ESP_LOGI(TAG, "Overcurrent trip armed on GPIO %d (%s)", config->fault_gpio_num,
+             config->mode == OVERCURRENT_TRIP_ONE_SHOT ? "one-shot" : "cycle-by-cycle");
+    return ESP_OK;
+}
+
+esp_err_t overcurrent_trip_attach_latency_probe(mcpwm_cap_timer_handle_t cap_timer, int pwm_a_gpio_num)
+{
+    ESP_RETURN_ON_FALSE(cap_timer && trip_fault, ESP_ERR_INVALID_STATE, TAG, "trip not initialized");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_timer_get_resolution(cap_timer, &cap_resolution_hz), TAG, "get capture resolution failed");
+    match_window_ticks = (uint32_t)((uint64_t)cap_resolution_hz * TRIP_MATCH_WINDOW_NS / 1000000000ULL);
+    if (match_window_ticks == 0) {
+        match_window_ticks = 1;
+    }
+
+    mcpwm_cap_channel_handle_t fault_chan = NULL;
+    mcpwm_capture_channel_config_t fault_chan_config = {
+        .gpio_num = trip_fault_gpio,
+        .prescale = 1,
+        .flags.pos_edge = trip_fault_active_high,
+        .flags.neg_edge = !trip_fault_active_high,
+        .flags.pull_down = trip_fault_active_high, // same pulls as the fault, the channel reconfigures the pad
+        .flags.pull_up = !trip_fault_active_high,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_channel(cap_timer, &fault_chan_config, &fault_chan), TAG, "create fault capture failed");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_register_event_callbacks(fault_chan, &(mcpwm_capture_event_callbacks_t){
+        .on_cap = fault_edge_capture_cb,
+    }, NULL), TAG, "register fault capture callback failed");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_enable(fault_chan), TAG, "enable fault capture failed");
+
+    mcpwm_cap_channel_handle_t pwm_a_chan = NULL;
+    mcpwm_capture_channel_config_t pwm_a_chan_config = {
+        .gpio_num = pwm_a_gpio_num,
+        .prescale = 1,
+        .flags.pos_edge = false,
+        .flags.neg_edge = true,
+        .flags.io_loop_back = true, // keep the gate drive output enabled, only add the input path
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_channel(cap_timer, &pwm_a_chan_config, &pwm_a_chan), TAG, "create PWM0A capture failed");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_register_event_callbacks(pwm_a_chan, &(mcpwm_capture_event_callbacks_t){
+        .on_cap = pwm_a_fall_capture_cb,
+    }, NULL), TAG, "register PWM0A capture callback failed");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_enable(pwm_a_chan), TAG, "enable PWM0A capture failed");
+    return ESP_OK;
+}
+
+esp_err_t overcurrent_trip_set_mode(overcurrent_trip_mode_t mode)
+{
+    ESP_RETURN_ON_FALSE(trip_oper && trip_fault, ESP_ERR_INVALID_STATE, TAG, "trip not initialized");
+    mcpwm_brake_config_t brake_config = {
+        .fault = trip_fault,
+        .brake_mode = mode == OVERCURRENT_TRIP_ONE_SHOT ? MCPWM_OPER_BRAKE_MODE_OST : MCPWM_OPER_BRAKE_MODE_CBC,
+        .flags.cbc_recover_on_tez = true,
+    };
+    ESP_RETURN_ON_ERROR(mcpwm_operator_set_brake_on_fault(trip_oper, &brake_config), TAG, "set brake failed");
+    return ESP_OK;
+}
+
+esp_err_t overcurrent_trip_clear_latch(void)
+{
+    ESP_RETURN_ON_FALSE(trip_oper && trip_fault, ESP_ERR_INVALID_STATE, TAG, "trip not initialized");
+    ESP_RETURN_ON_FALSE(gpio_get_level(trip_fault_gpio) != trip_fault_active_high, ESP_ERR_INVALID_STATE, TAG, "fault still active");
+    ESP_RETURN_ON_ERROR(mcpwm_operator_recover_from_fault(trip_oper, trip_fault), TAG, "recover from fault failed");
+    ost_latched = false;
+    return ESP_OK;
+}
+
+uint32_t IRAM_ATTR overcurrent_trip_cbc_cycles(void)
+{
+    return cbc_cycle_count;
+}
+
+void overcurrent_trip_get_stats(overcurrent_trip_stats_t *out_stats)
+{
+    out_stats->trips = trip_count;
+    out_stats->cbc_cycles = cbc_cycle_count;
+    out_stats->ost_latches = ost_latch_count;
+    out_stats->already_off = already_off_count;
+    out_stats->last_latency_ns = last_latency_ns;
+    out_stats->max_latency_ns = max_latency_ns;
+    out_stats->latched = ost_latched;
+}
+
+bool overcurrent_trip_poll(overcurrent_trip_stats_t *out_stats)
+{
+    uint32_t trips = trip_count;
+    bool tripped = trips != seen_trip_count;
+    if (tripped && cap_resolution_hz) {
+        // Only the most recent trip of a burst is timed, the rest count as untimed trips
+        if (trip_matched) {
+            last_latency_ns = (uint32_t)((uint64_t)matched_latency_ticks * 1000000000ULL / cap_resolution_hz);
+            if (last_latency_ns > max_latency_ns) {
+                max_latency_ns = last_latency_ns;
+            }
+        } else {
+            already_off_count++;
+        }
+    }
+    seen_trip_count = trips;
+
+    if (out_stats) {
+        overcurrent_trip_get_stats(out_stats);
+        out_stats->trips = trips;
+    }
+    return tripped;
+}
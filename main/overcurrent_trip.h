@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/mcpwm_prelude.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief How the half-bridge recovers from an overcurrent trip
+ */
+typedef enum {
+    OVERCURRENT_TRIP_CYCLE_BY_CYCLE, // Outputs come back on the next TEZ after the fault input clears
+    OVERCURRENT_TRIP_ONE_SHOT,       // Outputs stay off until overcurrent_trip_clear_latch() is called
+} overcurrent_trip_mode_t;
+
+/**
+ * @brief Overcurrent trip configuration
+ */
+typedef struct {
+    int fault_gpio_num;           // Comparator / fault input, shared with the latency probe capture channel
+    bool fault_active_high;       // Level of fault_gpio_num that means "overcurrent"
+    overcurrent_trip_mode_t mode; // Initial recovery mode
+} overcurrent_trip_config_t;
+
+/**
+ * @brief Trip counters for telemetry
+ */
+typedef struct {
+    uint32_t trips;             // Fault input edges (one per overcurrent event)
+    uint32_t cbc_cycles;        // PWM cycles spent braked in cycle-by-cycle mode
+    uint32_t ost_latches;       // One-shot latches taken
+    uint32_t already_off;       // Trips that landed while PWM0A was already low
+    uint32_t last_latency_ns;   // Fault edge -> PWM0A low, last measured trip
+    uint32_t max_latency_ns;    // Fault edge -> PWM0A low, worst measured trip
+    bool latched;               // One-shot latch currently holding the outputs off
+} overcurrent_trip_stats_t;
+
+/**
+ * @brief Create the GPIO fault and bind it to the operator brake so both generators go low on a trip
+ *
+ * Must be called after the generators are created and before the timer is started,
+ * so the bridge is protected from the first PWM cycle.
+ *
+ * @param[in] config Trip configuration
+ * @param[in] oper Operator driving the half-bridge
+ * @param[in] gen_a High side generator
+ * @param[in] gen_b Low side generator
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK on success, or the error returned by the MCPWM driver
+ */
+esp_err_t overcurrent_trip_init(const overcurrent_trip_config_t *config, mcpwm_oper_handle_t oper, mcpwm_gen_handle_t gen_a, mcpwm_gen_handle_t gen_b);
+
+/**
+ * @brief Attach capture channels on the fault input and PWM0A to timestamp trip-to-output-off
+ *
+ * Takes two capture channels. With the breakdown capture that is all three of an ESP32 MCPWM group.
+ * The PWM0A channel is created with io_loop_back, so the pad stays an output.
+ *
+ * @param[in] cap_timer Capture timer of the same MCPWM group (ESP32 has one per group)
+ * @param[in] pwm_a_gpio_num GPIO of the high side output, generator must have io_loop_back set
+ * @return
+ *      - ESP_OK on success, or the error returned by the MCPWM driver
+ */
+esp_err_t overcurrent_trip_attach_latency_probe(mcpwm_cap_timer_handle_t cap_timer, int pwm_a_gpio_num);
+
+/**
+ * @brief Switch between cycle-by-cycle and one-shot recovery at runtime
+ */
+esp_err_t overcurrent_trip_set_mode(overcurrent_trip_mode_t mode);
+
+/**
+ * @brief Release a one-shot latch
+ *
+ * @return
+ *      - ESP_ERR_INVALID_STATE if the fault input is still active
+ *      - ESP_OK if the outputs are released (they resume on the next TEZ)
+ */
+esp_err_t overcurrent_trip_clear_latch(void);
+
+/**
+ * @brief Cycle-by-cycle brake events so far, safe to call from an IRAM ISR
+ */
+uint32_t overcurrent_trip_cbc_cycles(void);
+
+/**
+ * @brief Snapshot of the counters without folding pending trips, safe from any task
+ *
+ * The latency fields are as of the last overcurrent_trip_poll().
+ */
+void overcurrent_trip_get_stats(overcurrent_trip_stats_t *out_stats);
+
+/**
+ * @brief Fold pending trip timestamps into the counters, call from one task only
+ *
+ * @param[out] out_stats Snapshot of the counters, can be NULL
+ * @return true if a trip happened since the previous call
+ */
+bool overcurrent_trip_poll(overcurrent_trip_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,100 @@
+#include <string.h>
+#include "crc16.h"
+#include "session_block.h"
+
+#define MAX_SAMPLE_BYTES (5 + 3 + 5 + 1) // varint u32, zigzag i16 delta, zigzag i32 delta, packed byte
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v & 0xFFFF);
+    put_u16(p + 2, v >> 16);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t put_varint(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static uint8_t pack(const session_sample_t *sample)
+{
+    return ((sample->servo + 1) & 0x03) | ((sample->pulse_class & 0x03) << 2);
+}
+
+void session_block_begin(session_block_t *block, uint32_t seq, uint8_t flags, const session_sample_t *first)
+{
+    memset(block->data, 0, SESSION_BLOCK_SIZE);
+    put_u32(&block->data[0], SESSION_BLOCK_MAGIC);
+    put_u32(&block->data[4], seq);
+    put_u32(&block->data[8], first->time_ms);
+    put_u32(&block->data[12], (uint32_t)first->position_steps);
+    put_u16(&block->data[16], first->gap_adc);
+    block->data[18] = pack(first);
+    block->data[20] = flags;
+    block->payload_len = 0;
+    block->count = 1;
+    block->last = *first;
+}
+
+bool session_block_append(session_block_t *block, const session_sample_t *sample)
+{
+    uint8_t encoded[MAX_SAMPLE_BYTES];
+    if (block->count == UINT8_MAX) {
+        return false;
+    }
+    size_t n = put_varint(encoded, sample->time_ms - block->last.time_ms);
+    n += put_varint(encoded + n, zigzag((int32_t)sample->gap_adc - block->last.gap_adc));
+    n += put_varint(encoded + n, zigzag(sample->position_steps - block->last.position_steps));
+    encoded[n++] = pack(sample);
+    if (block->payload_len + n > SESSION_BLOCK_PAYLOAD_MAX) {
+        return false;
+    }
+    memcpy(&block->data[SESSION_BLOCK_HEADER_SIZE + block->payload_len], encoded, n);
+    block->payload_len += n;
+    block->count++;
+    block->last = *sample;
+    return true;
+}
+
+void session_block_finish(session_block_t *block)
+{
+    block->data[19] = block->count;
+    put_u16(&block->data[22], block->payload_len);
+    put_u16(&block->data[SESSION_BLOCK_SIZE - 2], crc16_ccitt(block->data, SESSION_BLOCK_SIZE - 2));
+}
+
+bool session_block_valid(const uint8_t *data, uint32_t *out_seq)
+{
+    if (get_u32(data) != SESSION_BLOCK_MAGIC) {
+        return false;
+    }
+    uint16_t crc = data[SESSION_BLOCK_SIZE - 2] | (data[SESSION_BLOCK_SIZE - 1] << 8);
+    if (crc != crc16_ccitt(data, SESSION_BLOCK_SIZE - 2)) {
+        return false;
+    }
+    if (out_seq) {
+        *out_seq = get_u32(&data[4]);
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pulse class of a recorded sample, from the gap voltage
+ */
+typedef enum {
+    SESSION_PULSE_OPEN,   // Gap above the servo window, no discharge
+    SESSION_PULSE_NORMAL, // Gap inside the servo window
+    SESSION_PULSE_ARC,    // Gap below the servo window
+    SESSION_PULSE_SHORT,  // Gap collapsed (or an overcurrent trip)
+} session_pulse_class_t;
+
+/**
+ * @brief Servo decision of a recorded sample
+ */
+typedef enum {
+    SESSION_SERVO_RETRACT = -1,
+    SESSION_SERVO_HOLD = 0,
+    SESSION_SERVO_ADVANCE = 1,
+    SESSION_SERVO_LIFT = 2,
+} session_servo_t;
+
+/**
+ * @brief One telemetry sample
+ */
+typedef struct {
+    uint32_t time_ms;       // Milliseconds since boot
+    int32_t position_steps; // Electrode position, positive towards the workpiece
+    uint16_t gap_adc;       // Filtered gap voltage, raw ADC
+    int8_t servo;           // session_servo_t
+    uint8_t pulse_class;    // session_pulse_class_t
+} session_sample_t;
+
+/*
+ * Block layout, little endian, SESSION_BLOCK_SIZE bytes:
+ *   0  u32 magic              SESSION_BLOCK_MAGIC
+ *   4  u32 seq                increments by one per block, orders the ring after a wrap
+ *   8  u32 base time_ms       first sample, stored as is
+ *  12  i32 base position_steps
+ *  16  u16 base gap_adc
+ *  18  u8  base packed        bits 0-1 servo + 1, bits 2-3 pulse class
+ *  19  u8  sample count       including the base sample
+ *  20  u8  flags              SESSION_BLOCK_FLAG_*
+ *  21  u8  reserved (0)
+ *  22  u16 payload length
+ *  24  payload                per further sample: varint dt, zigzag varint d_gap,
+ *                             zigzag varint d_position, u8 packed
+ * 254  u16 CRC-16/CCITT-FALSE over bytes 0..253
+ */
+#define SESSION_BLOCK_SIZE 256
+#define SESSION_BLOCK_MAGIC 0x524D4445 // "EDMR"
+#define SESSION_BLOCK_HEADER_SIZE 24
+#define SESSION_BLOCK_PAYLOAD_MAX (SESSION_BLOCK_SIZE - SESSION_BLOCK_HEADER_SIZE - 2)
+#define SESSION_BLOCK_FLAG_SESSION_START 0x01 // First block of a cut
+
+/**
+ * @brief Block being filled
+ */
+typedef struct {
+    uint8_t data[SESSION_BLOCK_SIZE];
+    uint16_t payload_len;
+    uint8_t count;
+    session_sample_t last;
+} session_block_t;
+
+/**
+ * @brief Start a block with its first sample
+ */
+void session_block_begin(session_block_t *block, uint32_t seq, uint8_t flags, const session_sample_t *first);
+
+/**
+ * @brief Delta encode a sample into the block
+ *
+ * @return false if the sample does not fit, the block is left unchanged
+ */
+bool session_block_append(session_block_t *block, const session_sample_t *sample);
+
+/**
+ * @brief Write payload length and CRC, the block data is then ready for flash
+ */
+void session_block_finish(session_block_t *block);
+
+/**
+ * @brief Check magic and CRC of a block read back from flash
+ *
+ * @param[in] data SESSION_BLOCK_SIZE bytes
+ * @param[out] out_seq Sequence number of a valid block, can be NULL
+ */
+bool session_block_valid(const uint8_t *data, uint32_t *out_seq);
+
+#ifdef __cplusplus
+}
+#endif
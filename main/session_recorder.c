@@ -0,0 +1,231 @@
+#include <inttypes.h>
+#include <string.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "session_recorder.h"
+
+static const char *TAG = "session_rec";
+
+#define SESSION_PARTITION_SUBTYPE 0x40  // "cutlog" in partitions.csv
+#define SESSION_SAMPLE_INTERVAL_MS 100  // Decimation: 10 samples/s whatever the servo rate
+#define SESSION_QUEUE_LEN 32            // 3.2 s of samples before the writer must catch up
+#define SESSION_TASK_PRIORITY 1         // Below every control task
+#define SESSION_SECTOR_SIZE 4096
+#define SESSION_ERASE_AHEAD_SECTORS 128 // Erased reserve, ~3 h of cutting at the rate below
+#define SESSION_ERASE_IDLE_MS 500       // Queue silence before the next pre-erase between cuts
+
+/*
+ * Write cost, at 10 samples/s with the servo mostly holding or single stepping:
+ * about 4-5 bytes per sample, so ~45 B/s, one 256 byte block every ~5.5 s and one
+ * 4 KB sector erase every ~90 s. The 1 MB partition rotates every ~6 h of cutting,
+ * which puts 100k erase cycles per sector well beyond the life of the machine.
+ * host_test/test_session_recorder.py checks the byte rate.
+ *
+ * Erase and write disable the flash cache on both cores: tasks and non-IRAM interrupts stall
+ * for ~1 ms per block and ~45 ms (up to ~400 ms) per sector erase, see README. Sectors are
+ * therefore erased ahead of the write pointer while no cut is running, and a cut only ever
+ * writes blocks. If a cut uses up the erased reserve, further blocks are dropped and counted
+ * rather than erasing mid-cut.
+ */
+
+typedef enum {
+    RECORDER_MSG_SAMPLE,
+    RECORDER_MSG_SESSION_START,
+    RECORDER_MSG_FLUSH,
+} recorder_msg_type_t;
+
+typedef struct {
+    recorder_msg_type_t type;
+    session_sample_t sample;
+} recorder_msg_t;
+
+static const esp_partition_t *recorder_partition = NULL;
+static QueueHandle_t recorder_queue = NULL;
+static uint32_t write_offset = 0;
+static uint32_t erased_bytes = 0;      // Erased space from write_offset on, write_offset + erased_bytes is sector aligned
+static uint32_t erase_ahead_limit = 0; // Reserve target, at most half the partition
+static uint32_t next_seq = 0;
+static session_block_t block; // only touched by the writer task
+
+// Producer side, touched by the cut loop only
+static uint32_t last_logged_ms = 0;
+static bool logged_any = false;
+
+static volatile uint32_t samples_logged = 0;
+static volatile uint32_t samples_dropped = 0;
+static volatile uint32_t blocks_written = 0;
+static volatile uint32_t sectors_erased = 0;
+static volatile uint32_t blocks_dropped = 0;
+static volatile bool recorder_faulted = false;
+
+// Find the newest valid block and continue right after it, so every sector gets erased in turn
+static void recorder_resume(void)
+{
+    uint8_t data[SESSION_BLOCK_SIZE];
+    bool found = false;
+    uint32_t newest_seq = 0;
+    uint32_t newest_offset = 0;
+    for (uint32_t offset = 0; offset + SESSION_BLOCK_SIZE <= recorder_partition->size; offset += SESSION_BLOCK_SIZE) {
+        uint32_t seq;
+        if (esp_partition_read(recorder_partition, offset, data, sizeof(data)) != ESP_OK || !session_block_valid(data, &seq)) {
+            continue;
+        }
+        if (!found || (int32_t)(seq - newest_seq) > 0) {
+            found = true;
+            newest_seq = seq;
+            newest_offset = offset;
+        }
+    }
+    if (found) {
+        next_seq = newest_seq + 1;
+        write_offset = (newest_offset + SESSION_BLOCK_SIZE) % recorder_partition->size;
+    }
+    // Only the rest of the current sector is known to be erased, the reserve is rebuilt while idle
+    erased_bytes = (SESSION_SECTOR_SIZE - write_offset % SESSION_SECTOR_SIZE) % SESSION_SECTOR_SIZE;
+    ESP_LOGI(TAG, "Resuming at offset 0x%" PRIx32 ", block %" PRIu32, write_offset, next_seq);
+}
+
+// Erase the sector after the erased reserve. Only called between cuts.
+static void recorder_erase_ahead(void)
+{
+    uint32_t offset = (write_offset + erased_bytes) % recorder_partition->size;
+    if (esp_partition_erase_range(recorder_partition, offset, SESSION_SECTOR_SIZE) != ESP_OK) {
+        // Writing over a sector in an unknown state would corrupt the ring, stop recording instead
+        ESP_LOGE(TAG, "Erase at 0x%" PRIx32 " failed, recorder stopped", offset);
+        recorder_faulted = true;
+        return;
+    }
+    sectors_erased++;
+    erased_bytes += SESSION_SECTOR_SIZE;
+}
+
+static void recorder_write_block(void)
+{
+    session_block_finish(&block);
+    // Never erase here, it may be mid-cut. Without erased space the block is lost.
+    if (recorder_faulted || erased_bytes < SESSION_BLOCK_SIZE) {
+        blocks_dropped++;
+        return;
+    }
+    if (esp_partition_write(recorder_partition, write_offset, block.data, SESSION_BLOCK_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Write at 0x%" PRIx32 " failed", write_offset);
+        blocks_dropped++;
+    } else {
+        blocks_written++;
+    }
+    erased_bytes -= SESSION_BLOCK_SIZE;
+    write_offset = (write_offset + SESSION_BLOCK_SIZE) % recorder_partition->size;
+}
+
+static void session_recorder_task(void *pvParameters)
+{
+    bool block_open = false;
+    bool cut_active = false; // From a session start or sample until the next flush
+    uint8_t pending_flags = 0;
+    recorder_msg_t msg;
+    while (1) {
+        // Between cuts, top up the erased reserve one sector per idle interval
+        bool erase_due = !cut_active && !recorder_faulted && erased_bytes < erase_ahead_limit;
+        if (xQueueReceive(recorder_queue, &msg, erase_due ? pdMS_TO_TICKS(SESSION_ERASE_IDLE_MS) : portMAX_DELAY) != pdTRUE) {
+            if (erase_due) {
+                recorder_erase_ahead();
+            }
+            continue;
+        }
+        switch (msg.type) {
+        case RECORDER_MSG_SESSION_START:
+            cut_active = true;
+            if (block_open) {
+                recorder_write_block();
+                block_open = false;
+            }
+            pending_flags = SESSION_BLOCK_FLAG_SESSION_START;
+            break;
+        case RECORDER_MSG_SAMPLE:
+            cut_active = true; // a resumed cut sends no session start
+            if (block_open && session_block_append(&block, &msg.sample)) {
+                break;
+            }
+            if (block_open) {
+                recorder_write_block();
+            }
+            session_block_begin(&block, next_seq++, pending_flags, &msg.sample);
+            pending_flags = 0;
+            block_open = true;
+            break;
+        case RECORDER_MSG_FLUSH:
+            cut_active = false;
+            if (block_open) {
+                recorder_write_block();
+                block_open = false;
+            }
+            break;
+        }
+    }
+}
+
+esp_err_t session_recorder_init(void)
+{
+    recorder_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SESSION_PARTITION_SUBTYPE, NULL);
+    ESP_RETURN_ON_FALSE(recorder_partition, ESP_ERR_NOT_FOUND, TAG, "no cutlog partition");
+    recorder_resume();
+    erase_ahead_limit = SESSION_ERASE_AHEAD_SECTORS * SESSION_SECTOR_SIZE;
+    if (erase_ahead_limit > recorder_partition->size / 2) {
+        erase_ahead_limit = recorder_partition->size / 2;
+    }
+    recorder_queue = xQueueCreate(SESSION_QUEUE_LEN, sizeof(recorder_msg_t));
+    ESP_RETURN_ON_FALSE(recorder_queue, ESP_ERR_NO_MEM, TAG, "no mem for recorder queue");
+    BaseType_t ok = xTaskCreate(session_recorder_task, "session_recorder", 3072, NULL, SESSION_TASK_PRIORITY, NULL);
+    ESP_RETURN_ON_FALSE(ok == pdPASS, ESP_ERR_NO_MEM, TAG, "no mem for recorder task");
+    return ESP_OK;
+}
+
+static bool recorder_send(const recorder_msg_t *msg, TickType_t wait)
+{
+    return recorder_queue && xQueueSend(recorder_queue, msg, wait) == pdTRUE;
+}
+
+void session_recorder_log(const session_sample_t *sample)
+{
+    if (logged_any && sample->time_ms - last_logged_ms < SESSION_SAMPLE_INTERVAL_MS) {
+        return;
+    }
+    logged_any = true;
+    last_logged_ms = sample->time_ms;
+    recorder_msg_t msg = { .type = RECORDER_MSG_SAMPLE, .sample = *sample };
+    if (recorder_send(&msg, 0)) {
+        samples_logged++;
+    } else {
+        samples_dropped++;
+    }
+}
+
+void session_recorder_session_start(void)
+{
+    logged_any = false; // record the first sample of the cut right away
+    recorder_msg_t msg = { .type = RECORDER_MSG_SESSION_START };
+    // Cut start and stop are outside the servo path, a short wait beats losing the marker
+    recorder_send(&msg, pdMS_TO_TICKS(10));
+}
+
+void session_recorder_flush(void)
+{
+    recorder_msg_t msg = { .type = RECORDER_MSG_FLUSH };
+    recorder_send(&msg, pdMS_TO_TICKS(10));
+}
+
+void session_recorder_get_stats(session_recorder_stats_t *out_stats)
+{
+    out_stats->samples_logged = samples_logged;
+    out_stats->samples_dropped = samples_dropped;
+    out_stats->blocks_written = blocks_written;
+    out_stats->sectors_erased = sectors_erased;
+    out_stats->blocks_dropped = blocks_dropped;
+    out_stats->write_offset = write_offset;
+    out_stats->erased_bytes = erased_bytes;
+    out_stats->faulted = recorder_faulted;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "session_block.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Recorder counters
+ */
+typedef struct {
+    uint32_t samples_logged;  // Samples accepted after decimation
+    uint32_t samples_dropped; // Samples lost because the queue was full
+    uint32_t blocks_written;  // Blocks written since boot
+    uint32_t sectors_erased;  // Flash sectors erased since boot, only ever between cuts
+    uint32_t blocks_dropped;  // Blocks lost to a used up erased reserve, a write error or a fault
+    uint32_t write_offset;    // Next block position in the partition
+    uint32_t erased_bytes;    // Erased reserve ahead of write_offset
+    bool faulted;             // A sector erase failed, recording stopped until reboot
+} session_recorder_stats_t;
+
+/**
+ * @brief Find the cutlog partition, resume after the newest block in it and start the writer task
+ *
+ * @return
+ *      - ESP_ERR_NOT_FOUND if the partition table has no cutlog partition
+ *      - ESP_ERR_NO_MEM if the queue or task cannot be created
+ *      - ESP_OK on success
+ */
+esp_err_t session_recorder_init(void);
+
+/**
+ * @brief Queue a sample, decimated to one per SESSION_SAMPLE_INTERVAL_MS
+ *
+ * Never blocks: when the writer task falls behind the sample is dropped and counted.
+ */
+void session_recorder_log(const session_sample_t *sample);
+
+/**
+ * @brief Mark the start of a cut, the next block is flagged as a session start
+ */
+void session_recorder_session_start(void);
+
+/**
+ * @brief Write the partially filled block, call when a cut stops
+ *
+ * Once the queue has been idle for a while after a flush, the writer task erases sectors
+ * ahead of the write pointer, one at a time, so the next cut only writes blocks.
+ */
+void session_recorder_flush(void);
+
+/**
+ * @brief Snapshot of the recorder counters
+ */
+void session_recorder_get_stats(session_recorder_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
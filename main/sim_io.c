@@ -0,0 +1,135 @@
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "driver/rmt_tx.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "sim_io.h"
+
+#define SIM_SURFACE_STEPS 300          // Workpiece surface, from the electrode position at boot
+#define SIM_JOG_STOP_STEPS 50          // Scenario releases jog down this far before the surface
+#define SIM_GAP_ADC_PER_STEP 100       // Gap reading per step of distance, 500-2000 is 5-20 steps
+#define SIM_SPARK_GAP_STEPS 20         // Discharges happen at this distance and closer
+#define SIM_EROSION_US_PER_STEP 40000  // Sparking time to remove one step of material
+#define SIM_CAPTURE_PERIOD_US 1000     // Stand-in for the breakdown capture, wakes adc_on_capture_task
+#define SIM_SETTLE_MS 500
+#define SIM_REPORT_MS 1000
+
+static const char *TAG = "sim";
+
+extern volatile int32_t electrode_position_steps; // main.c
+extern SemaphoreHandle_t capture_semaphore; // MCPWM_task.c
+
+static sim_io_config_t sim_config;
+static volatile uint64_t input_levels;  // One bit per GPIO, only for the configured inputs
+static uint64_t input_mask;
+static volatile int32_t surface_steps = SIM_SURFACE_STEPS;
+static volatile uint32_t transmits;
+static volatile bool jog_down_polled; // the stepper loop is running
+static int64_t erosion_us;
+static int64_t last_read_us;
+
+int __real_gpio_get_level(gpio_num_t gpio_num);
+
+int __wrap_gpio_get_level(gpio_num_t gpio_num)
+{
+    if (input_mask & (1ULL << gpio_num)) {
+        if (gpio_num == sim_config.jog_down_gpio) {
+            jog_down_polled = true;
+        }
+        return (input_levels >> gpio_num) & 1;
+    }
+    return __real_gpio_get_level(gpio_num);
+}
+
+// Gap channel, called from adc_on_capture_task only
+esp_err_t __wrap_adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t chan, int *out_raw)
+{
+    int64_t now_us = esp_timer_get_time();
+    int32_t distance = surface_steps - electrode_position_steps;
+    if (distance > 0 && distance <= SIM_SPARK_GAP_STEPS && last_read_us) {
+        erosion_us += now_us - last_read_us;
+        while (erosion_us >= SIM_EROSION_US_PER_STEP) {
+            erosion_us -= SIM_EROSION_US_PER_STEP;
+            surface_steps++;
+        }
+    }
+    last_read_us = now_us;
+    int32_t raw = distance * SIM_GAP_ADC_PER_STEP;
+    *out_raw = raw < 0 ? 0 : raw > 4095 ? 4095 : raw;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload,
+                              size_t payload_bytes, const rmt_transmit_config_t *config)
+{
+    transmits++;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel, int timeout_ms)
+{
+    return ESP_OK;
+}
+
+// The MCPWM capture ISR never fires without a breakdown edge, the gap ADC is sampled from here instead
+static void sim_capture_cb(void *arg)
+{
+    xSemaphoreGive(capture_semaphore);
+}
+
+static void set_input(int gpio_num, int level)
+{
+    if (level) {
+        input_levels |= 1ULL << gpio_num;
+    } else {
+        input_levels &= ~(1ULL << gpio_num);
+    }
+}
+
+static void sim_scenario_task(void *arg)
+{
+    while (!jog_down_polled) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+    ESP_LOGI(TAG, "Scenario: jog down to %d steps before the surface", SIM_JOG_STOP_STEPS);
+    set_input(sim_config.jog_down_gpio, 1);
+    while (surface_steps - electrode_position_steps > SIM_JOG_STOP_STEPS) {
+        vTaskDelay(1);
+    }
+    set_input(sim_config.jog_down_gpio, 0);
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+    ESP_LOGI(TAG, "Scenario: start cut at %" PRId32 " steps, surface at %" PRId32, electrode_position_steps, surface_steps);
+    set_input(sim_config.start_cut_gpio, 1);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SIM_REPORT_MS));
+        ESP_LOGI(TAG, "position=%" PRId32 " surface=%" PRId32 " transmits=%" PRIu32, electrode_position_steps, surface_steps,
+                 transmits);
+    }
+}
+
+esp_err_t sim_io_start(const sim_io_config_t *config)
+{
+    sim_config = *config;
+    input_mask = 1ULL << config->jog_up_gpio | 1ULL << config->jog_down_gpio | 1ULL << config->limit_switch_gpio |
+                 1ULL << config->start_cut_gpio;
+    input_levels = 1ULL << config->limit_switch_gpio; // limit OK, buttons released, start off
+    capture_semaphore = xSemaphoreCreateBinary();
+    if (!capture_semaphore || xTaskCreate(sim_scenario_task, "sim_scenario", 2048, NULL, 4, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_timer_handle_t capture_timer;
+    const esp_timer_create_args_t capture_timer_args = {
+        .callback = sim_capture_cb,
+        .name = "sim_capture",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&capture_timer_args, &capture_timer), TAG, "create capture timer failed");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(capture_timer, SIM_CAPTURE_PERIOD_US), TAG, "start capture timer failed");
+    ESP_LOGW(TAG, "Simulated I/O, inputs and step output are not connected");
+    return ESP_OK;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Input pins taken over by the simulation
+ */
+typedef struct {
+    int jog_up_gpio;
+    int jog_down_gpio;
+    int limit_switch_gpio;
+    int start_cut_gpio;
+} sim_io_config_t;
+
+/**
+ * @brief Start the simulated I/O and the scripted jog-and-cut scenario
+ *
+ * Only built with CONFIG_EDM_SIM_IO, for running the firmware image under QEMU, which has no RMT,
+ * MCPWM or ADC models. The build links gpio_get_level(), adc_oneshot_read(), rmt_transmit() and
+ * rmt_tx_wait_all_done() to replacements in sim_io.c:
+ *
+ * - The configured inputs follow the scenario, other pins read the real GPIO.
+ * - The gap ADC reads a workpiece model: the reading is proportional to the distance between the
+ *   electrode and the surface, and the surface erodes while the gap sparks.
+ * - Step transmits are counted and complete at once.
+ * - An esp_timer gives capture_semaphore every millisecond in place of the breakdown capture
+ *   interrupt, so adc_on_capture_task keeps sampling the gap. The real capture can fire at the
+ *   20 kHz PWM rate, but 1 kHz already refreshes the 8 sample filter within one 20 ms servo loop.
+ *
+ * Call before the stepper task starts reading the inputs.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NO_MEM if the scenario task or the capture semaphore cannot be created
+ *      - Errors from esp_timer_create() and esp_timer_start_periodic()
+ */
+esp_err_t sim_io_start(const sim_io_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,121 @@
+#include "stepper_curve.h"
+
+static float convert_to_smooth_freq(uint32_t freq1, uint32_t freq2, uint32_t freqx)
+{
+    float normalize_x = ((float)(freqx - freq1)) / (freq2 - freq1);
+    // third-order "smoothstep" function: https://en.wikipedia.org/wiki/Smoothstep
+    float smooth_x = normalize_x * normalize_x * (3 - 2 * normalize_x);
+    return smooth_x * (freq2 - freq1) + freq1;
+}
+
+// rmt_symbol_word_t: duration0 bits 0-14, level0 bit 15, duration1 bits 16-30, level1 bit 31
+// fill_table() rejects curves whose slowest point needs more than STEPPER_SYMBOL_MAX_TICKS
+static uint32_t step_symbol(uint32_t symbol_duration)
+{
+    return symbol_duration | (symbol_duration << 16) | (1u << 31);
+}
+
+static bool fill_table(stepper_curve_t *curve, uint32_t slot, const stepper_curve_config_t *config)
+{
+    if (!config->resolution || config->sample_points < 2 || config->sample_points > curve->max_points ||
+            config->start_freq_hz == config->end_freq_hz) {
+        return false;
+    }
+    uint32_t slowest_hz = config->start_freq_hz < config->end_freq_hz ? config->start_freq_hz : config->end_freq_hz;
+    if (slowest_hz < stepper_min_freq_hz(config->resolution)) { // half period would wrap the 15 bit duration
+        return false;
+    }
+    uint32_t *table = curve->storage + slot * curve->max_points;
+    bool is_accel_curve = config->start_freq_hz < config->end_freq_hz;
+    uint32_t curve_step = 0;
+    if (is_accel_curve) {
+        curve_step = (config->end_freq_hz - config->start_freq_hz) / (config->sample_points - 1);
+        for (uint32_t i = 0; i < config->sample_points; i++) {
+            float smooth_freq = convert_to_smooth_freq(config->start_freq_hz, config->end_freq_hz, config->start_freq_hz + curve_step * i);
+            uint32_t symbol_duration = config->resolution / smooth_freq / 2;
+            table[i] = step_symbol(symbol_duration);
+        }
+    } else {
+        curve_step = (config->start_freq_hz - config->end_freq_hz) / (config->sample_points - 1);
+        for (uint32_t i = 0; i < config->sample_points; i++) {
+            float smooth_freq = convert_to_smooth_freq(config->end_freq_hz, config->start_freq_hz, config->end_freq_hz + curve_step * i);
+            uint32_t symbol_duration = config->resolution / smooth_freq / 2;
+            table[config->sample_points - i - 1] = step_symbol(symbol_duration);
+        }
+    }
+    if (curve_step == 0) { // |end_freq_hz - start_freq_hz| smaller than sample_points
+        return false;
+    }
+    curve->points[slot] = config->sample_points;
+    curve->is_accel[slot] = is_accel_curve;
+    return true;
+}
+
+bool stepper_curve_init(stepper_curve_t *curve, uint32_t *storage, uint32_t max_points, const stepper_curve_config_t *config)
+{
+    curve->storage = storage;
+    curve->max_points = max_points;
+    for (uint32_t i = 0; i < STEPPER_CURVE_SLOTS; i++) {
+        curve->points[i] = 0;
+        curve->is_accel[i] = true;
+    }
+    curve->front = 0;
+    curve->handoff = 1;
+    curve->back = 2;
+    return fill_table(curve, curve->front, config);
+}
+
+bool stepper_curve_prepare(stepper_curve_t *curve, const stepper_curve_config_t *config)
+{
+    return fill_table(curve, curve->back, config);
+}
+
+void stepper_curve_publish(stepper_curve_t *curve)
+{
+    // Release: the table writes are visible before the encoder can see the slot
+    uint32_t previous = __atomic_exchange_n(&curve->handoff, curve->back | STEPPER_CURVE_FRESH, __ATOMIC_ACQ_REL);
+    curve->back = previous & ~STEPPER_CURVE_FRESH;
+}
+
+void stepper_curve_begin(stepper_curve_t *curve)
+{
+    if (__atomic_load_n(&curve->handoff, __ATOMIC_ACQUIRE) & STEPPER_CURVE_FRESH) {
+        uint32_t previous = __atomic_exchange_n(&curve->handoff, curve->front, __ATOMIC_ACQ_REL);
+        curve->front = previous & ~STEPPER_CURVE_FRESH;
+    }
+}
+
+uint32_t stepper_uniform_symbols(uint32_t resolution, uint32_t freq_hz, uint32_t *out_symbols)
+{
+    if (!freq_hz) {
+        return 0;
+    }
+    uint32_t half_period = resolution / freq_hz / 2;
+    uint32_t pieces = (half_period + STEPPER_SYMBOL_MAX_TICKS - 1) / STEPPER_SYMBOL_MAX_TICKS;
+    if (!pieces || pieces > STEPPER_UNIFORM_MAX_SYMBOLS) {
+        return 0;
+    }
+    // Low half then high half, pieces per half, two pieces per symbol
+    for (uint32_t i = 0; i < 2 * pieces; i++) {
+        uint32_t piece = i % pieces;
+        uint32_t duration = half_period / pieces + (piece < half_period % pieces);
+        uint32_t half_word = duration | (i >= pieces ? 0x8000u : 0);
+        if (i % 2 == 0) {
+            out_symbols[i / 2] = half_word;
+        } else {
+            out_symbols[i / 2] |= half_word << 16;
+        }
+    }
+    return pieces;
+}
+
+const uint32_t *stepper_curve_symbols(const stepper_curve_t *curve, uint32_t steps, uint32_t *out_count)
+{
+    uint32_t points = curve->points[curve->front];
+    const uint32_t *table = curve->storage + curve->front * curve->max_points;
+    if (steps > points) {
+        steps = points;
+    }
+    *out_count = steps;
+    return curve->is_accel[curve->front] ? table : table + points - steps;
+}
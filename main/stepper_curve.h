@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Curve settings, see stepper_motor_curve_encoder_config_t
+ */
+typedef struct {
+    uint32_t resolution;    // Encoder resolution, in Hz
+    uint32_t sample_points; // Steps in the curve, at least 2 and |end_freq_hz - start_freq_hz| >= sample_points
+    uint32_t start_freq_hz; // Start frequency on the curve, in Hz
+    uint32_t end_freq_hz;   // End frequency on the curve, in Hz
+} stepper_curve_config_t;
+
+#define STEPPER_CURVE_SLOTS 3
+
+// rmt_symbol_word_t durations are 15 bit, one step is two symbol halves
+#define STEPPER_SYMBOL_MAX_TICKS 0x7FFF
+
+/**
+ * @brief Lowest step frequency whose half period fits one symbol duration at this resolution
+ */
+static inline uint32_t stepper_min_freq_hz(uint32_t resolution)
+{
+    return resolution / (2 * (STEPPER_SYMBOL_MAX_TICKS + 1)) + 1;
+}
+
+// Most symbols a uniform step is split over, the uniform encoder's buffer size
+#define STEPPER_UNIFORM_MAX_SYMBOLS 8
+
+/**
+ * @brief Lowest step frequency stepper_uniform_symbols() can build at this resolution
+ */
+static inline uint32_t stepper_uniform_min_freq_hz(uint32_t resolution)
+{
+    return resolution / (2 * STEPPER_UNIFORM_MAX_SYMBOLS * STEPPER_SYMBOL_MAX_TICKS) + 1;
+}
+
+/**
+ * @brief Build one step at a fixed frequency, for the uniform encoder
+ *
+ * A half period longer than STEPPER_SYMBOL_MAX_TICKS is split evenly over several symbol
+ * durations at the same level, so slow feeds need no lower resolution.
+ *
+ * @param[out] out_symbols STEPPER_UNIFORM_MAX_SYMBOLS symbols, rmt_symbol_word_t layout
+ * @return Number of symbols, 0 if freq_hz is above resolution / 2 or below stepper_uniform_min_freq_hz()
+ */
+uint32_t stepper_uniform_symbols(uint32_t resolution, uint32_t freq_hz, uint32_t *out_symbols);
+
+/**
+ * @brief Curve tables handed from an updater task to the encoder without locks or allocation
+ *
+ * Triple buffer: the updater fills its back slot and swaps it with the handoff slot, the encoder
+ * swaps the handoff slot with its front slot when a transaction starts. Each side only ever
+ * writes a slot it owns, so a transaction in flight keeps its table to the end whatever the
+ * updater does, and the updater never waits on the encoder. Publishing twice before a transaction
+ * starts simply replaces the set that was not picked up yet.
+ *
+ * One updater at a time. Symbols are in rmt_symbol_word_t layout.
+ */
+typedef struct {
+    uint32_t *storage;                        // STEPPER_CURVE_SLOTS * max_points symbols
+    uint32_t max_points;
+    uint32_t points[STEPPER_CURVE_SLOTS];
+    bool is_accel[STEPPER_CURVE_SLOTS];
+    uint32_t back;                            // Updater side
+    uint32_t front;                           // Encoder side, the table of the current transaction
+    volatile uint32_t handoff;                // Slot index, STEPPER_CURVE_FRESH while not picked up
+} stepper_curve_t;
+
+#define STEPPER_CURVE_FRESH 0x80u
+
+/**
+ * @brief Set up the slots over caller provided storage and build the initial table into the front slot
+ *
+ * @param[in] storage STEPPER_CURVE_SLOTS * max_points symbols
+ * @return false if the config is invalid, has more than max_points points or its slowest point is
+ *         below stepper_min_freq_hz()
+ */
+bool stepper_curve_init(stepper_curve_t *curve, uint32_t *storage, uint32_t max_points, const stepper_curve_config_t *config);
+
+/**
+ * @brief Build a table into the back slot, invisible to the encoder until stepper_curve_publish()
+ *
+ * @return false if the config is invalid, has more than max_points points or its slowest point is
+ *         below stepper_min_freq_hz(), the back slot is then undefined
+ */
+bool stepper_curve_prepare(stepper_curve_t *curve, const stepper_curve_config_t *config);
+
+/**
+ * @brief Hand the prepared table over, the next transaction uses it
+ */
+void stepper_curve_publish(stepper_curve_t *curve);
+
+/**
+ * @brief Encoder side: start a transaction, picking up a published table if there is one
+ */
+void stepper_curve_begin(stepper_curve_t *curve);
+
+/**
+ * @brief Encoder side: symbols for a move of `steps` steps on the current table
+ *
+ * Acceleration curves play from their start, deceleration curves play out to their end.
+ *
+ * @param[out] out_count Number of symbols, steps clamped to the table length
+ */
+const uint32_t *stepper_curve_symbols(const stepper_curve_t *curve, uint32_t steps, uint32_t *out_count);
+
+#ifdef __cplusplus
+}
+#endif
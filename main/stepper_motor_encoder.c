@@ -4,27 +4,21 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <inttypes.h>
 #include "esp_check.h"
 #include "stepper_motor_encoder.h"
+#include "stepper_curve.h"
 
 static const char *TAG = "stepper_motor_encoder";
 
-static float convert_to_smooth_freq(uint32_t freq1, uint32_t freq2, uint32_t freqx)
-{
-    float normalize_x = ((float)(freqx - freq1)) / (freq2 - freq1);
-    // third-order "smoothstep" function: https://en.wikipedia.org/wiki/Smoothstep
-    float smooth_x = normalize_x * normalize_x * (3 - 2 * normalize_x);
-    return smooth_x * (freq2 - freq1) + freq1;
-}
+_Static_assert(sizeof(rmt_symbol_word_t) == sizeof(uint32_t), "stepper_curve.c builds symbols as 32 bit words");
 
 typedef struct {
     rmt_encoder_t base;
     rmt_encoder_handle_t copy_encoder;
-    uint32_t sample_points;
-    struct {
-        uint32_t is_accel_curve: 1;
-    } flags;
-    rmt_symbol_word_t curve_table[];
+    stepper_curve_t curve;
+    bool in_transaction; // The table is latched for the whole transaction, across refills
+    uint32_t storage[];  // STEPPER_CURVE_SLOTS curve tables
 } rmt_stepper_curve_encoder_t;
 
 static size_t rmt_encode_stepper_motor_curve(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
@@ -32,14 +26,15 @@ static size_t rmt_encode_stepper_motor_curve(rmt_encoder_t *encoder, rmt_channel
     rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
     rmt_encoder_handle_t copy_encoder = motor_encoder->copy_encoder;
     rmt_encode_state_t session_state = RMT_ENCODING_RESET;
-    uint32_t points_num = *(uint32_t *)primary_data;
-    size_t encoded_symbols = 0;
-    if (motor_encoder->flags.is_accel_curve) {
-        encoded_symbols = copy_encoder->encode(copy_encoder, channel, &motor_encoder->curve_table[0],
-                                               points_num * sizeof(rmt_symbol_word_t), &session_state);
-    } else {
-        encoded_symbols = copy_encoder->encode(copy_encoder, channel, &motor_encoder->curve_table[0] + motor_encoder->sample_points - points_num,
-                                               points_num * sizeof(rmt_symbol_word_t), &session_state);
+    if (!motor_encoder->in_transaction) {
+        stepper_curve_begin(&motor_encoder->curve);
+        motor_encoder->in_transaction = true;
+    }
+    uint32_t points_num;
+    const uint32_t *symbols = stepper_curve_symbols(&motor_encoder->curve, *(uint32_t *)primary_data, &points_num);
+    size_t encoded_symbols = copy_encoder->encode(copy_encoder, channel, symbols, points_num * sizeof(rmt_symbol_word_t), &session_state);
+    if (session_state & RMT_ENCODING_COMPLETE) {
+        motor_encoder->in_transaction = false;
     }
     *ret_state = session_state;
     return encoded_symbols;
@@ -57,51 +52,40 @@ static esp_err_t rmt_reset_stepper_motor_curve_encoder(rmt_encoder_t *encoder)
 {
     rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
     rmt_encoder_reset(motor_encoder->copy_encoder);
+    motor_encoder->in_transaction = false;
     return ESP_OK;
 }
 
+static void curve_config_from_encoder_config(const stepper_motor_curve_encoder_config_t *config, stepper_curve_config_t *out)
+{
+    out->resolution = config->resolution;
+    out->sample_points = config->sample_points;
+    out->start_freq_hz = config->start_freq_hz;
+    out->end_freq_hz = config->end_freq_hz;
+}
+
 esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
 {
     esp_err_t ret = ESP_OK;
     rmt_stepper_curve_encoder_t *step_encoder = NULL;
-    float smooth_freq;
-    uint32_t symbol_duration;
     ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid arguments");
     ESP_GOTO_ON_FALSE(config->sample_points, ESP_ERR_INVALID_ARG, err, TAG, "sample points number can't be zero");
     ESP_GOTO_ON_FALSE(config->start_freq_hz != config->end_freq_hz, ESP_ERR_INVALID_ARG, err, TAG, "start freq can't equal to end freq");
-    step_encoder = rmt_alloc_encoder_mem(sizeof(rmt_stepper_curve_encoder_t) + config->sample_points * sizeof(rmt_symbol_word_t));
+    uint32_t max_points = config->max_sample_points ? config->max_sample_points : config->sample_points;
+    ESP_GOTO_ON_FALSE(max_points >= config->sample_points, ESP_ERR_INVALID_ARG, err, TAG, "sample points exceed max sample points");
+    // All slots are allocated here, so updates never allocate
+    step_encoder = rmt_alloc_encoder_mem(sizeof(rmt_stepper_curve_encoder_t) + STEPPER_CURVE_SLOTS * max_points * sizeof(rmt_symbol_word_t));
     ESP_GOTO_ON_FALSE(step_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for stepper curve encoder");
     rmt_copy_encoder_config_t copy_encoder_config = {};
     ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &step_encoder->copy_encoder), err, TAG, "create copy encoder failed");
-    bool is_accel_curve = config->start_freq_hz < config->end_freq_hz;
 
     // prepare the curve table, in RMT symbol format
-    uint32_t curve_step = 0;
-    if (is_accel_curve) {
-        curve_step = (config->end_freq_hz - config->start_freq_hz) / (config->sample_points - 1);
-        for (uint32_t i = 0; i < config->sample_points; i++) {
-            smooth_freq = convert_to_smooth_freq(config->start_freq_hz, config->end_freq_hz, config->start_freq_hz + curve_step * i);
-            symbol_duration = config->resolution / smooth_freq / 2;
-            step_encoder->curve_table[i].level0 = 0;
-            step_encoder->curve_table[i].duration0 = symbol_duration;
-            step_encoder->curve_table[i].level1 = 1;
-            step_encoder->curve_table[i].duration1 = symbol_duration;
-        }
-    } else {
-        curve_step = (config->start_freq_hz - config->end_freq_hz) / (config->sample_points - 1);
-        for (uint32_t i = 0; i < config->sample_points; i++) {
-            smooth_freq = convert_to_smooth_freq(config->end_freq_hz, config->start_freq_hz, config->end_freq_hz + curve_step * i);
-            symbol_duration = config->resolution / smooth_freq / 2;
-            step_encoder->curve_table[config->sample_points - i - 1].level0 = 0;
-            step_encoder->curve_table[config->sample_points - i - 1].duration0 = symbol_duration;
-            step_encoder->curve_table[config->sample_points - i - 1].level1 = 1;
-            step_encoder->curve_table[config->sample_points - i - 1].duration1 = symbol_duration;
-        }
-    }
-    ESP_GOTO_ON_FALSE(curve_step > 0, ESP_ERR_INVALID_ARG, err, TAG, "|end_freq_hz - start_freq_hz| can't be smaller than sample_points");
+    stepper_curve_config_t curve_config;
+    curve_config_from_encoder_config(config, &curve_config);
+    ESP_GOTO_ON_FALSE(stepper_curve_init(&step_encoder->curve, step_encoder->storage, max_points, &curve_config), ESP_ERR_INVALID_ARG, err,
+                      TAG, "|end_freq_hz - start_freq_hz| can't be smaller than sample_points");
 
-    step_encoder->sample_points = config->sample_points;
-    step_encoder->flags.is_accel_curve = is_accel_curve;
+    step_encoder->in_transaction = false;
     step_encoder->base.del = rmt_del_stepper_motor_curve_encoder;
     step_encoder->base.encode = rmt_encode_stepper_motor_curve;
     step_encoder->base.reset = rmt_reset_stepper_motor_curve_encoder;
@@ -117,10 +101,30 @@ err:
     return ret;
 }
 
+esp_err_t rmt_stepper_motor_curve_encoder_prepare(rmt_encoder_handle_t encoder, const stepper_motor_curve_encoder_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(encoder && config && encoder->encode == rmt_encode_stepper_motor_curve, ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+    rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
+    stepper_curve_config_t curve_config;
+    curve_config_from_encoder_config(config, &curve_config);
+    ESP_RETURN_ON_FALSE(stepper_curve_prepare(&motor_encoder->curve, &curve_config), ESP_ERR_INVALID_ARG, TAG,
+                        "invalid curve or more than %" PRIu32 " sample points", motor_encoder->curve.max_points);
+    return ESP_OK;
+}
+
+esp_err_t rmt_stepper_motor_curve_encoder_swap(rmt_encoder_handle_t encoder)
+{
+    ESP_RETURN_ON_FALSE(encoder && encoder->encode == rmt_encode_stepper_motor_curve, ESP_ERR_INVALID_ARG, TAG, "invalid arguments");
+    rmt_stepper_curve_encoder_t *motor_encoder = __containerof(encoder, rmt_stepper_curve_encoder_t, base);
+    stepper_curve_publish(&motor_encoder->curve);
+    return ESP_OK;
+}
+
 typedef struct {
     rmt_encoder_t base;
     rmt_encoder_handle_t copy_encoder;
     uint32_t resolution;
+    uint32_t symbols[STEPPER_UNIFORM_MAX_SYMBOLS]; // One step, slow half periods span several symbols
 } rmt_stepper_uniform_encoder_t;
 
 static size_t rmt_encode_stepper_motor_uniform(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
@@ -129,14 +133,9 @@ static size_t rmt_encode_stepper_motor_uniform(rmt_encoder_t *encoder, rmt_chann
     rmt_encoder_handle_t copy_encoder = motor_encoder->copy_encoder;
     rmt_encode_state_t session_state = RMT_ENCODING_RESET;
     uint32_t target_freq_hz = *(uint32_t *)primary_data;
-    uint32_t symbol_duration = motor_encoder->resolution / target_freq_hz / 2;
-    rmt_symbol_word_t freq_sample = {
-        .level0 = 0,
-        .duration0 = symbol_duration,
-        .level1 = 1,
-        .duration1 = symbol_duration,
-    };
-    size_t encoded_symbols = copy_encoder->encode(copy_encoder, channel, &freq_sample, sizeof(freq_sample), &session_state);
+    // Callers keep target_freq_hz within stepper_uniform_min_freq_hz() and resolution / 2
+    uint32_t symbols_num = stepper_uniform_symbols(motor_encoder->resolution, target_freq_hz, motor_encoder->symbols);
+    size_t encoded_symbols = copy_encoder->encode(copy_encoder, channel, motor_encoder->symbols, symbols_num * sizeof(rmt_symbol_word_t), &session_state);
     *ret_state = session_state;
     return encoded_symbols;
 }
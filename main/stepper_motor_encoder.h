@@ -20,6 +20,7 @@ typedef struct {
     uint32_t sample_points; // Sample points used for deceleration phase. Note: |end_freq_hz - start_freq_hz| >= sample_points
     uint32_t start_freq_hz; // Start frequency on the curve, in Hz
     uint32_t end_freq_hz;   // End frequency on the curve, in Hz
+    uint32_t max_sample_points; // Largest sample_points a later update may use, 0 to keep sample_points
 } stepper_motor_curve_encoder_config_t;
 
 /**
@@ -41,9 +42,41 @@ typedef struct {
  */
 esp_err_t rmt_new_stepper_motor_curve_encoder(const stepper_motor_curve_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Build a new curve into the curve encoder's spare table, in the background of any transmit
+ *
+ * The encoder keeps using its current curve until rmt_stepper_motor_curve_encoder_swap(). Nothing
+ * is allocated, the tables were sized by max_sample_points at creation. Only one task may update
+ * a given encoder.
+ *
+ * @param[in] encoder Curve encoder handle
+ * @param[in] config New curve, resolution included
+ * @return
+ *      - ESP_ERR_INVALID_ARG for an invalid curve, more than max_sample_points points or a non curve encoder
+ *      - ESP_OK if the curve is ready to swap in
+ */
+esp_err_t rmt_stepper_motor_curve_encoder_prepare(rmt_encoder_handle_t encoder, const stepper_motor_curve_encoder_config_t *config);
+
+/**
+ * @brief Make the prepared curve current, from the next transaction on
+ *
+ * Never blocks and is safe while the channel is transmitting: a transaction already being encoded
+ * finishes on the curve it started with, every transaction that starts later uses the new one.
+ *
+ * @param[in] encoder Curve encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for a non curve encoder
+ *      - ESP_OK on success
+ */
+esp_err_t rmt_stepper_motor_curve_encoder_swap(rmt_encoder_handle_t encoder);
+
 /**
  * @brief Create RMT encoder for encoding step motor uniform phase into RMT symbols
  *
+ * Each transaction is one step at the frequency passed as primary data, from
+ * stepper_uniform_min_freq_hz() up to resolution / 2. Slow steps are split over up to
+ * STEPPER_UNIFORM_MAX_SYMBOLS symbols.
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
@@ -0,0 +1,93 @@
+# SPDX-License-Identifier: CC0-1.0
+# Boots the firmware under the ESP32 QEMU emulator with simulated I/O (CONFIG_EDM_SIM_IO, see
+# main/sim_io.h), runs the scripted jog-and-cut scenario and fails on performance regressions.
+# Build the image with sdkconfig.ci.qemu first, see "QEMU regression run" in README.md.
+import re
+
+import pytest
+from pytest_embedded_qemu.dut import QemuDut
+
+# Limits, raise one only together with the change that needs it. No QEMU run was available when they
+# were set, so they are derived from the budget below rather than measured. After the first run, check
+# them against the summary line this test prints (pytest -s) and tighten any that is far off.
+# Margin: 25% on everything except the fixed servo delay.
+MARGIN = 1.25
+SERVO_DELAY_US = 20000      # vTaskDelay(pdMS_TO_TICKS(20)) at CONFIG_FREERTOS_HZ=1000
+TICK_US = 1000              # wake-up jitter, one tick
+CPU_BUSY_MAX_US = 5000      # gap read, servo decision, queue posts and up to four log lines, 2-3x slower under QEMU
+CPU_BUSY_AVG_US = 2000
+BLOCK_WRITE_US = 3000       # recorder block write, flash cache off on both cores (datasheet worst case)
+BLOCK_WRITE_PERIOD_US = 5500000  # one 256 byte block every ~5.5 s of cutting, see main/session_recorder.c
+SECTOR_ERASE_US = 45000     # sectors are erased between cuts only, but an idle erase can still be running
+                            # when the cut starts (typical time; the 400 ms worst case is not covered)
+
+BOOT_MS_MAX = 2500              # esp_timer at "Ready": bootloader, init and the recorder scan of its 1 MB partition
+LOOP_BUSY_MAX_US_MAX = int(MARGIN * (CPU_BUSY_MAX_US + BLOCK_WRITE_US))  # servo iteration excluding the delay
+LOOP_PERIOD_AVG_US_MAX = SERVO_DELAY_US + int(MARGIN * (TICK_US + CPU_BUSY_AVG_US +
+                                                        BLOCK_WRITE_US * SERVO_DELAY_US // BLOCK_WRITE_PERIOD_US))
+# Worst period: a block write during the busy part, another one delaying the wake-up, and an idle sector
+# erase that overlaps the first iterations of the cut
+LOOP_PERIOD_MAX_US_MAX = SERVO_DELAY_US + int(MARGIN * (TICK_US + CPU_BUSY_MAX_US + 2 * BLOCK_WRITE_US + SECTOR_ERASE_US))
+MIN_FREE_HEAP_MIN = 100000      # esp_get_minimum_free_heap_size(): ~200 KB expected after init, keeps 2x headroom
+STACK_FREE_MIN = 512            # stepper_task high water mark, 1/8 of its 4 KB stack
+CUT_TIMEOUT_S = 180
+
+STEPS_PER_MM = 200 / 4.0        # steps_per_rev / leadscrew_pitch_mm in main/main.c
+
+PERF_RE = re.compile(rb'perf: loops=(\d+) period avg=(\d+) max=(\d+) us, busy avg=(\d+) max=(\d+) us, '
+                     rb'heap free=(\d+) min=(\d+), stack free=(\d+), position=(-?\d+)')
+COMPLETE_RE = re.compile(rb'Cut program complete at ([\d.]+) mm')
+
+
+@pytest.mark.esp32
+@pytest.mark.host_test
+@pytest.mark.qemu
+@pytest.mark.parametrize('embedded_services, build_dir', [('idf,qemu', 'build_esp32_qemu')], indirect=True)
+def test_edm_jog_and_cut(dut: QemuDut) -> None:
+    final_depth_mm = float(dut.expect(rb'Cut program loaded: \d+ stages, final depth ([\d.]+) mm', timeout=30).group(1))
+    boot_ms = int(dut.expect(rb'Ready, (\d+) ms after boot', timeout=5).group(1))
+
+    dut.expect_exact('Scenario: jog down', timeout=10)
+    dut.expect_exact('Jog DOWN pressed', timeout=5)
+    dut.expect_exact('Jog DOWN: decel phase', timeout=10)
+    start = dut.expect(rb'Scenario: start cut at (-?\d+) steps', timeout=10)
+    start_position = int(start.group(1))
+    assert start_position > 0, 'jog did not move the electrode'
+    dut.expect_exact('Start EDM cut', timeout=5)
+
+    reports = []
+    while True:
+        match = dut.expect([PERF_RE, COMPLETE_RE], timeout=CUT_TIMEOUT_S)
+        if match.group(0).startswith(b'Cut program complete'):
+            depth_mm = float(match.group(1))
+            break
+        reports.append([int(v) for v in match.groups()])
+    # Heap and stack after the cut, including the recorder flush at the end
+    reports.append([int(v) for v in dut.expect(PERF_RE, timeout=5).groups()])
+    sim = dut.expect(rb'sim: position=(-?\d+) surface=(-?\d+) transmits=(\d+)', timeout=5)
+    position, surface, transmits = (int(v) for v in sim.groups())
+
+    servo = [r for r in reports if r[0] > 0]
+    assert servo, 'no servo loop timing reported during the cut'
+    loops = sum(r[0] for r in servo)
+    period_avg_us = sum(r[0] * r[1] for r in servo) // loops
+    period_max_us = max(r[2] for r in servo)
+    busy_max_us = max(r[4] for r in servo)
+    min_free_heap = min(r[6] for r in reports)
+    stack_free = min(r[7] for r in reports)
+    print('boot {} ms, {} servo loops, period avg {} us max {} us, busy max {} us, min free heap {} B, stack free {} B, '
+          '{} transmits, depth {:.3f} mm'.format(boot_ms, loops, period_avg_us, period_max_us, busy_max_us, min_free_heap,
+                                                 stack_free, transmits, depth_mm))
+
+    # Step output: the electrode followed the eroding surface down to the programmed depth
+    assert depth_mm == pytest.approx(final_depth_mm, abs=2 / STEPS_PER_MM)
+    assert position - start_position == pytest.approx(final_depth_mm * STEPS_PER_MM, abs=2)
+    assert 0 < surface - position <= 25
+    assert transmits >= position - start_position
+
+    assert boot_ms <= BOOT_MS_MAX
+    assert period_avg_us <= LOOP_PERIOD_AVG_US_MAX
+    assert period_max_us <= LOOP_PERIOD_MAX_US_MAX
+    assert busy_max_us <= LOOP_BUSY_MAX_US_MAX
+    assert min_free_heap >= MIN_FREE_HEAP_MIN
+    assert stack_free >= STACK_FREE_MIN
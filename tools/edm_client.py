@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: CC0-1.0
+"""Host client for the binary command/telemetry protocol on the console UART.
+
+    python tools/edm_client.py /dev/ttyUSB0 get duty_percent
+    python tools/edm_client.py /dev/ttyUSB0 set cut_speed_um_s 80
+    python tools/edm_client.py /dev/ttyUSB0 jog -- -200
+    python tools/edm_client.py /dev/ttyUSB0 clear-trip
+    python tools/edm_client.py /dev/ttyUSB0 monitor --rate 20 -o telemetry.csv
+
+Serial ports need pyserial. The frame format is described in main/edm_protocol.h.
+"""
+import argparse
+import csv
+import os
+import select
+import struct
+import sys
+import time
+from typing import Callable, Iterator, List, NamedTuple, Optional
+
+from session_decode import PULSE_NAMES, SERVO_NAMES, crc16
+
+SOF = 0xA5
+HEADER = struct.Struct('<BBBH')
+MAX_PAYLOAD = 240
+
+MSG_PING = 0x01
+MSG_PONG = 0x02
+MSG_GET_PARAM = 0x10
+MSG_PARAM = 0x11
+MSG_SET_PARAM = 0x12
+MSG_COMMAND = 0x20
+MSG_TELEMETRY = 0x30
+MSG_ACK = 0x7E
+MSG_NACK = 0x7F
+
+NACK_REASONS = {1: 'unknown type', 2: 'bad length', 3: 'unknown parameter', 4: 'out of range',
+                5: 'unknown command', 6: 'busy', 7: 'read only'}
+
+PARAMS = {
+    'duty_percent': 1,
+    'cut_speed_um_s': 2,
+    'gap_low': 3,
+    'gap_high': 4,
+    'isopulse_enable': 5,
+    'isopulse_on_ns': 6,
+    'isopulse_off_ns': 7,
+    'isopulse_ignition_ns': 8,
+    'telemetry_hz': 9,
+    'jog_speed_um_s': 10,
+    'peak_current_ma': 11,
+    'trip_count': 12,
+    'trip_cbc_cycles': 13,
+    'trip_ost_latches': 14,
+    'trip_latched': 15,
+}
+READ_ONLY_PARAMS = {'trip_count', 'trip_cbc_cycles', 'trip_ost_latches', 'trip_latched'}
+
+CMD_START = 1
+CMD_STOP = 2
+CMD_JOG = 3
+CMD_CLEAR_TRIP = 4
+
+TELEMETRY_RECORD = struct.Struct('<IiHbB')
+
+
+class Frame(NamedTuple):
+    type: int
+    seq: int
+    payload: bytes
+
+
+class TelemetrySample(NamedTuple):
+    time_ms: int
+    position_steps: int
+    gap_adc: int
+    servo: int
+    pulse_class: int
+
+
+class NackError(Exception):
+    def __init__(self, request_type: int, reason: int) -> None:
+        super().__init__('request 0x{:02x} rejected: {}'.format(request_type, NACK_REASONS.get(reason, reason)))
+        self.request_type = request_type
+        self.reason = reason
+
+
+def encode_frame(msg_type: int, seq: int, payload: bytes = b'') -> bytes:
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError('payload too long')
+    body = struct.pack('<BBH', msg_type, seq, len(payload)) + payload
+    return bytes([SOF]) + body + struct.pack('<H', crc16(body))
+
+
+def decode_telemetry(payload: bytes) -> List[TelemetrySample]:
+    count = payload[0]
+    return [TelemetrySample(*TELEMETRY_RECORD.unpack_from(payload, 1 + i * TELEMETRY_RECORD.size)) for i in range(count)]
+
+
+class FrameParser:
+    """Mirror of edm_proto_feed(), bytes outside frames are kept as console text"""
+
+    def __init__(self) -> None:
+        self.buf = bytearray()
+        self.console = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data: bytes) -> Iterator[Frame]:
+        self.buf += data
+        while self.buf:
+            if self.buf[0] != SOF:
+                skip = self.buf.find(bytes([SOF]))
+                skip = len(self.buf) if skip < 0 else skip
+                self.console += self.buf[:skip]
+                del self.buf[:skip]
+                continue
+            if len(self.buf) < HEADER.size:
+                return
+            _, msg_type, seq, length = HEADER.unpack_from(self.buf)
+            if length > MAX_PAYLOAD:
+                self.console += self.buf[:1]
+                del self.buf[:1]
+                continue
+            end = HEADER.size + length + 2
+            if len(self.buf) < end:
+                return
+            crc, = struct.unpack_from('<H', self.buf, end - 2)
+            if crc != crc16(bytes(self.buf[1:end - 2])):
+                self.crc_errors += 1
+                self.console += self.buf[:1]
+                del self.buf[:1]
+                continue
+            frame = Frame(msg_type, seq, bytes(self.buf[HEADER.size:end - 2]))
+            del self.buf[:end]
+            yield frame
+
+
+class FdTransport:
+    """Raw file descriptor, e.g. a pty or a serial device already configured with stty"""
+
+    def __init__(self, fd: int) -> None:
+        self.fd = fd
+
+    def read(self, timeout: float) -> bytes:
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        return os.read(self.fd, 4096) if ready else b''
+
+    def write(self, data: bytes) -> None:
+        while data:
+            data = data[os.write(self.fd, data):]
+
+
+class SerialTransport:
+    def __init__(self, port: str, baudrate: int) -> None:
+        import serial  # only needed for real hardware
+        self.serial = serial.Serial(port, baudrate, timeout=0)
+
+    def read(self, timeout: float) -> bytes:
+        self.serial.timeout = timeout
+        return self.serial.read(max(1, self.serial.in_waiting))
+
+    def write(self, data: bytes) -> None:
+        self.serial.write(data)
+
+
+class EdmClient:
+    def __init__(self, transport, timeout: float = 1.0) -> None:
+        self.transport = transport
+        self.timeout = timeout
+        self.parser = FrameParser()
+        self.seq = 0
+        self.telemetry: List[TelemetrySample] = []
+        self.telemetry_frames = 0
+        self.on_telemetry: Optional[Callable[[List[TelemetrySample]], None]] = None
+
+    def _dispatch(self, frame: Frame) -> Optional[Frame]:
+        if frame.type == MSG_TELEMETRY:
+            samples = decode_telemetry(frame.payload)
+            self.telemetry_frames += 1
+            self.telemetry += samples
+            if self.on_telemetry:
+                self.on_telemetry(samples)
+            return None
+        return frame
+
+    def poll(self, duration: float) -> None:
+        """Receive telemetry for `duration` seconds"""
+        deadline = time.monotonic() + duration
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return
+            for frame in self.parser.feed(self.transport.read(min(remaining, 0.5))):
+                self._dispatch(frame)
+
+    def request(self, msg_type: int, payload: bytes = b'') -> Frame:
+        self.seq = (self.seq + 1) & 0xFF
+        self.transport.write(encode_frame(msg_type, self.seq, payload))
+        deadline = time.monotonic() + self.timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise TimeoutError('no response to request 0x{:02x}'.format(msg_type))
+            for frame in self.parser.feed(self.transport.read(remaining)):
+                frame = self._dispatch(frame)
+                if frame is None or frame.seq != self.seq:
+                    continue
+                if frame.type == MSG_NACK:
+                    raise NackError(frame.payload[0], frame.payload[1])
+                return frame
+
+    def ping(self, payload: bytes = b'') -> bytes:
+        return self.request(MSG_PING, payload).payload
+
+    def get_param(self, name: str) -> int:
+        frame = self.request(MSG_GET_PARAM, bytes([PARAMS[name]]))
+        return struct.unpack_from('<i', frame.payload, 1)[0]
+
+    def set_param(self, name: str, value: int) -> int:
+        """Returns the value the firmware applied"""
+        frame = self.request(MSG_SET_PARAM, struct.pack('<Bi', PARAMS[name], value))
+        return struct.unpack_from('<i', frame.payload, 1)[0]
+
+    def command(self, command: int, arg: int = 0) -> None:
+        self.request(MSG_COMMAND, struct.pack('<Bi', command, arg))
+
+    def start(self) -> None:
+        self.command(CMD_START)
+
+    def stop(self) -> None:
+        self.command(CMD_STOP)
+
+    def jog(self, steps: int) -> None:
+        self.command(CMD_JOG, steps)
+
+    def clear_trip(self) -> None:
+        self.command(CMD_CLEAR_TRIP)
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', help='serial port of the board')
+    parser.add_argument('-b', '--baud', type=int, default=115200)
+    sub = parser.add_subparsers(dest='action', required=True)
+    get = sub.add_parser('get', help='read a parameter')
+    get.add_argument('name', choices=sorted(PARAMS) + ['all'])
+    set_ = sub.add_parser('set', help='write a parameter')
+    set_.add_argument('name', choices=sorted(set(PARAMS) - READ_ONLY_PARAMS))
+    set_.add_argument('value', type=int)
+    sub.add_parser('start', help='start the cut program')
+    sub.add_parser('stop', help='stop cutting')
+    sub.add_parser('clear-trip', help='release a one-shot overcurrent latch')
+    jog = sub.add_parser('jog', help='move the electrode, positive towards the workpiece')
+    jog.add_argument('steps', type=int)
+    monitor = sub.add_parser('monitor', help='stream telemetry as CSV')
+    monitor.add_argument('--rate', type=int, help='telemetry rate in Hz')
+    monitor.add_argument('-o', '--output', help='CSV output file (default: stdout)')
+    args = parser.parse_args(argv)
+
+    client = EdmClient(SerialTransport(args.port, args.baud))
+    try:
+        if args.action == 'get':
+            for name in sorted(PARAMS) if args.name == 'all' else [args.name]:
+                print('{} = {}'.format(name, client.get_param(name)))
+        elif args.action == 'set':
+            print('{} = {}'.format(args.name, client.set_param(args.name, args.value)))
+        elif args.action == 'start':
+            client.start()
+        elif args.action == 'stop':
+            client.stop()
+        elif args.action == 'clear-trip':
+            client.clear_trip()
+        elif args.action == 'jog':
+            client.jog(args.steps)
+        elif args.action == 'monitor':
+            if args.rate is not None:
+                client.set_param('telemetry_hz', args.rate)
+            else:
+                client.ping()  # the firmware only streams once a host has spoken
+            out = open(args.output, 'w', newline='') if args.output else sys.stdout
+            writer = csv.writer(out)
+            writer.writerow(TelemetrySample._fields)
+
+            def write(samples: List[TelemetrySample]) -> None:
+                for s in samples:
+                    writer.writerow([s.time_ms, s.position_steps, s.gap_adc,
+                                     SERVO_NAMES.get(s.servo, s.servo), PULSE_NAMES.get(s.pulse_class, s.pulse_class)])
+                out.flush()
+
+            client.on_telemetry = write
+            try:
+                client.poll(float('inf'))
+            except KeyboardInterrupt:
+                pass
+    except (NackError, TimeoutError) as e:
+        print(e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
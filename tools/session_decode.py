@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: CC0-1.0
+"""Convert a cutlog partition dump to CSV and print summary statistics.
+
+Read the partition from the board first, e.g.
+    parttool.py read_partition --partition-name cutlog --output cutlog.bin
+then
+    python tools/session_decode.py cutlog.bin -o cutlog.csv
+
+The block format is described in main/session_block.h.
+"""
+import argparse
+import csv
+import struct
+import sys
+from typing import Dict, Iterable, List, NamedTuple, Optional, TextIO
+
+BLOCK_SIZE = 256
+BLOCK_MAGIC = 0x524D4445
+HEADER = struct.Struct('<IIIiHBBBBH')
+FLAG_SESSION_START = 0x01
+
+SERVO_NAMES = {-1: 'retract', 0: 'hold', 1: 'advance', 2: 'lift'}
+PULSE_NAMES = {0: 'open', 1: 'normal', 2: 'arc', 3: 'short'}
+
+
+class Sample(NamedTuple):
+    session: int
+    time_ms: int
+    position_steps: int
+    gap_adc: int
+    servo: int
+    pulse_class: int
+
+
+class Block(NamedTuple):
+    seq: int
+    flags: int
+    samples: List[tuple]  # (time_ms, position_steps, gap_adc, servo, pulse_class)
+
+
+def crc16(data: bytes) -> int:
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def _varint(data: bytes, pos: int):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def _unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def _unpack(packed: int):
+    return (packed & 0x03) - 1, (packed >> 2) & 0x03
+
+
+def decode_block(data: bytes) -> Optional[Block]:
+    """Decode one block, None for erased or corrupt blocks"""
+    if len(data) != BLOCK_SIZE:
+        return None
+    magic, seq, time_ms, position, gap, packed, count, flags, _, payload_len = HEADER.unpack_from(data)
+    if magic != BLOCK_MAGIC or struct.unpack_from('<H', data, BLOCK_SIZE - 2)[0] != crc16(data[:BLOCK_SIZE - 2]):
+        return None
+    servo, pulse = _unpack(packed)
+    samples = [(time_ms, position, gap, servo, pulse)]
+    pos, end = HEADER.size, HEADER.size + payload_len
+    while pos < end and len(samples) < count:
+        dt, pos = _varint(data, pos)
+        d_gap, pos = _varint(data, pos)
+        d_pos, pos = _varint(data, pos)
+        servo, pulse = _unpack(data[pos])
+        pos += 1
+        time_ms = (time_ms + dt) & 0xFFFFFFFF
+        gap += _unzigzag(d_gap)
+        position += _unzigzag(d_pos)
+        samples.append((time_ms, position, gap, servo, pulse))
+    return Block(seq, flags, samples)
+
+
+def read_blocks(image: bytes) -> List[Block]:
+    """All valid blocks of a partition image, oldest first (the ring may have wrapped)"""
+    blocks = []
+    for offset in range(0, len(image) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        block = decode_block(image[offset:offset + BLOCK_SIZE])
+        if block:
+            blocks.append(block)
+    if not blocks:
+        return []
+    # Sequence numbers are consecutive, so the oldest block follows the largest gap
+    blocks.sort(key=lambda b: b.seq)
+    gaps = [(blocks[(i + 1) % len(blocks)].seq - blocks[i].seq) & 0xFFFFFFFF for i in range(len(blocks))]
+    start = (gaps.index(max(gaps)) + 1) % len(blocks)
+    return blocks[start:] + blocks[:start]
+
+
+def read_samples(image: bytes) -> List[Sample]:
+    samples = []
+    session = 0
+    for block in read_blocks(image):
+        if block.flags & FLAG_SESSION_START:
+            session += 1
+        samples.extend(Sample(session, *s) for s in block.samples)
+    return samples
+
+
+def write_csv(samples: Iterable[Sample], out: TextIO) -> None:
+    writer = csv.writer(out)
+    writer.writerow(['session', 'time_ms', 'position_steps', 'gap_adc', 'servo', 'pulse_class'])
+    for s in samples:
+        writer.writerow([s.session, s.time_ms, s.position_steps, s.gap_adc, SERVO_NAMES.get(s.servo, s.servo),
+                         PULSE_NAMES.get(s.pulse_class, s.pulse_class)])
+
+
+def summarize(samples: List[Sample]) -> List[Dict]:
+    """Per session statistics"""
+    sessions: Dict[int, List[Sample]] = {}
+    for s in samples:
+        sessions.setdefault(s.session, []).append(s)
+    summary = []
+    for session, items in sessions.items():
+        gaps = [s.gap_adc for s in items]
+        duration_ms = (items[-1].time_ms - items[0].time_ms) & 0xFFFFFFFF
+        summary.append({
+            'session': session,
+            'samples': len(items),
+            'duration_s': duration_ms / 1000.0,
+            'depth_steps': items[-1].position_steps - items[0].position_steps,
+            'gap_mean': sum(gaps) / len(gaps),
+            'gap_min': min(gaps),
+            'gap_max': max(gaps),
+            'servo': {name: sum(1 for s in items if s.servo == code) for code, name in SERVO_NAMES.items()},
+            'pulse': {name: sum(1 for s in items if s.pulse_class == code) for code, name in PULSE_NAMES.items()},
+        })
+    return summary
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('image', help='cutlog partition dump')
+    parser.add_argument('-o', '--output', help='CSV output file (default: stdout)')
+    args = parser.parse_args(argv)
+
+    with open(args.image, 'rb') as f:
+        samples = read_samples(f.read())
+    if args.output:
+        with open(args.output, 'w', newline='') as out:
+            write_csv(samples, out)
+    else:
+        write_csv(samples, sys.stdout)
+
+    for s in summarize(samples):
+        print('session {session}: {samples} samples, {duration_s:.1f} s, depth {depth_steps} steps, '
+              'gap mean {gap_mean:.0f} min {gap_min} max {gap_max}'.format(**s), file=sys.stderr)
+        print('  servo  ' + ' '.join('{}={}'.format(k, v) for k, v in s['servo'].items()), file=sys.stderr)
+        print('  pulse  ' + ' '.join('{}={}'.format(k, v) for k, v in s['pulse'].items()), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())